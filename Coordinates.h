@@ -2,5 +2,6 @@
 
 struct Coordinates {
     double lat_, lon_;
+    // Great-circle distance in metres; geo.h computes it from cached unit vectors
     static double dist(const Coordinates &lhs, const Coordinates &rhs);
 };
@@ -1,46 +1,48 @@
 #pragma once
 
-#include "Bus.h"
-#include "Stop.h"
-#include <iomanip>
-#include <iostream>
+#include "json_writer.h"
+#include "transport_catalog.h"
 #include <memory>
-#include <set>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
 #include <utility>
+#include <vector>
 
+// Names in responses are views into the catalog of the RouteManager that made
+// them, which must be kept alive until they are written
 namespace RouteItem {
     struct Item {
         double time;
         explicit Item(double time) : time(time) {}
         virtual ~Item() = default;
-        virtual std::ostream &operator<<(std::ostream &ostream) const = 0;
+        virtual void Write(Json::Writer &writer) const = 0;
     };
     struct Wait : public Item {
-        std::string stop_name;
-        Wait(std::string stop_name, double time) : Item(time), stop_name(std::move(stop_name)) {}
-        std::ostream &operator<<(std::ostream &ostream) const override {
-            return ostream << "        {\n"
-                           << "            \"type\": \"Wait\",\n"
-                           << "            \"stop_name\": " << '"' << stop_name << '"' << ",\n"
-                           << "            \"time\": " << time << "\n"
-                           << "        }";
+        std::string_view stop_name;
+        Wait(std::string_view stop_name, double time) : Item(time), stop_name(stop_name) {}
+        void Write(Json::Writer &writer) const override {
+            writer.BeginObject();
+            writer.Key("type").String("Wait");
+            writer.Key("stop_name").String(stop_name);
+            writer.Key("time").Double(time);
+            writer.EndObject();
         }
     };
     struct Bus : public Item {
-        std::string bus_name;
+        std::string_view bus_name;
         int span_cnt;
 
-        Bus(std::string bus_name, int span_cnt, double time)
-            : Item(time), bus_name(std::move(bus_name)), span_cnt(span_cnt) {}
-        std::ostream &operator<<(std::ostream &ostream) const override {
-            return ostream << "        {\n"
-                           << "            "
-                           << R"("type": "Bus")"
-                           << ",\n"
-                           << "            \"bus\": " << '"' << bus_name << ",\n"
-                           << "            \"span_count\": " << span_cnt << ",\n"
-                           << "            \"time\": " << time << "\n"
-                           << "        }";
+        Bus(std::string_view bus_name, int span_cnt, double time)
+            : Item(time), bus_name(bus_name), span_cnt(span_cnt) {}
+        void Write(Json::Writer &writer) const override {
+            writer.BeginObject();
+            writer.Key("type").String("Bus");
+            writer.Key("bus").String(bus_name);
+            writer.Key("span_count").Int(span_cnt);
+            writer.Key("time").Double(time);
+            writer.EndObject();
         }
     };
 }// namespace RouteItem
@@ -53,93 +55,45 @@ public:
     virtual ~Response() = default;
 
     explicit Response(int request_id) : request_id(request_id) {}
-    virtual std::ostream &operator<<(std::ostream &os) const = 0;
+    virtual void Write(Json::Writer &writer) const = 0;
 };
 
 
 struct BusStats : public Response {
-
 private:
-    std::string bus_name;
-    int num_of_stops_on_route = 0, num_of_unique_stops = 0, route_length = 0;
-    double curvature = 0;
-
-    static double CoordsWiseRouteLength(const Bus &bus) {
-        double res = 0;
-        const auto &stops = bus.GetStops();
-        for (size_t i = 0; i != stops.size() - 1; ++i)
-            res += Coordinates::dist(
-                    stops[i]->GetCoordinates(), stops[i + 1]->GetCoordinates());
-        if (!bus.isCircular())
-            res *= 2;
-        return res;
-    }
+    BusSummary summary_;
 
 public:
-    explicit BusStats(const Bus &bus, int request_id)
-        : Response(request_id),
-        bus_name(bus.GetId()),
-        num_of_unique_stops([&] {
-          std::vector<Stop *> v = bus.GetStops();
-          std::sort(v.begin(), v.end());
-          return std::unique(v.begin(), v.end()) - v.begin();
-        }()),
-        num_of_stops_on_route(bus.isCircular() ? bus.GetStops().size() : 2 * bus.GetStops().size() - 1) {
-
-            route_length = 0;
-            const auto &stops = bus.GetStops();
-            for (auto it = stops.begin(); it != std::prev(stops.end()); ++it) {
-                route_length += Stop::dist(*it, *std::next(it));
-            }
-            if (!bus.isCircular())
-                for (auto it = stops.rbegin(); it != std::prev(stops.rend()); ++it)
-                    route_length += Stop::dist(*it, *std::next(it));
-
-
-            curvature = route_length / CoordsWiseRouteLength(bus);
-    }
-
-    std::ostream &operator<<(std::ostream &os) const override {
-        return os << "    {\n"
-                  << "        \"request_id\": " << request_id << ",\n"
-                  << "        \"stop_count\": " << num_of_stops_on_route << ",\n"
-                  << "        \"unique_stop_count\": " << num_of_unique_stops << ",\n"
-                  << "        \"route_length\": " << route_length << ",\n"
-                  << "        \"curvature\": " << std::setprecision(16) << curvature << '\n'
-                  << "    }";
+    BusStats(const BusSummary &summary, int request_id) : Response(request_id), summary_(summary) {}
+
+    void Write(Json::Writer &writer) const override {
+        writer.BeginObject();
+        writer.Key("request_id").Int(request_id);
+        writer.Key("stop_count").Int(summary_.stop_count);
+        writer.Key("unique_stop_count").Int(summary_.unique_stop_count);
+        writer.Key("route_length").Int(summary_.route_length);
+        writer.Key("curvature").Double(summary_.curvature);
+        writer.EndObject();
     }
 };
 
 struct StopStats : public Response {
 private:
-    std::string stop_name;
-    std::vector<std::string_view> names_of_buses_that_stop_there;
+    const TransportCatalog &catalog_;
+    std::span<const BusId> buses_;// sorted by name
 
 public:
-    explicit StopStats(const Stop &stop, int request_id) : Response(request_id), stop_name(stop.GetName()) {
-        for (auto *bus_ptr : stop.GetBuses()) {
-            names_of_buses_that_stop_there.push_back(bus_ptr->GetId());
-        }
-    }
-    std::ostream &operator<<(std::ostream &os) const override {
-        os << "    {\n";
-        os << "        \"request_id\": " << request_id << ",\n";
-        os << "        \"buses\": ";
-        os << "[";
-        if (names_of_buses_that_stop_there.empty()) {
-            os << "]\n";
-        } else {
-            os << "\n";
-            for (auto it = names_of_buses_that_stop_there.begin(); it != names_of_buses_that_stop_there.end(); ++it) {
-                if (it != prev(names_of_buses_that_stop_there.end()))
-                    os << "            \"" << *it << "\",\n";
-                else
-                    os << "            \"" << *it << "\"\n";
-            }
-            os << "        ]\n";
-        }
-        os << "    }";
-        return os;
+    StopStats(const TransportCatalog &catalog, std::span<const BusId> buses, int request_id)
+        : Response(request_id), catalog_(catalog), buses_(buses) {}
+
+    void Write(Json::Writer &writer) const override {
+        writer.BeginObject();
+        writer.Key("request_id").Int(request_id);
+        writer.Key("buses").BeginArray();
+        for (const BusId bus : buses_)
+            writer.String(catalog_.GetBusName(bus));
+        writer.EndArray();
+        writer.EndObject();
     }
 };
 
@@ -147,12 +101,11 @@ public:
 struct StatsNotFound : public Response {
 public:
     explicit StatsNotFound(int request_id) : Response(request_id) {}
-    std::ostream &operator<<(std::ostream &os) const override {
-        return os << "    {\n"
-                  << "        \"request_id\": " << request_id << ",\n"
-                  << "        \"error_message\": "
-                  << "        \"not found\""
-                  << "    }";
+    void Write(Json::Writer &writer) const override {
+        writer.BeginObject();
+        writer.Key("request_id").Int(request_id);
+        writer.Key("error_message").String("not found");
+        writer.EndObject();
     }
 };
 
@@ -170,22 +123,65 @@ public:
             total_time += item->time;
     };
 
-    std::ostream &operator<<(std::ostream &os) const override {
-        os << "    {\n"
-           << "        \"request_id\": " << request_id << ",\n"
-           << "        \"total_time\": " << total_time << ",\n"
-           << "        \"items: \" ";
-        os << "[";
-        if (items_.empty()) {
-            os << "]\n";
-        } else {
-            os << "\n";
-            for (const auto &item_ptr : items_) {
-                item_ptr->operator<<(os);
-                os << ",\n";
+    void Write(Json::Writer &writer) const override {
+        writer.BeginObject();
+        writer.Key("request_id").Int(request_id);
+        writer.Key("total_time").Double(total_time);
+        writer.Key("items").BeginArray();
+        for (const auto &item_ptr : items_)
+            item_ptr->Write(writer);
+        writer.EndArray();
+        writer.EndObject();
+    }
+};
+
+
+// Total times of the routes from every source to every target, null where
+// there is none, and optionally the items of every route
+struct TravelTimes : public Response {
+private:
+    size_t source_count_, target_count_;
+    std::vector<std::optional<double>> total_times_;// row by row
+    bool with_items_;
+    std::vector<std::vector<std::shared_ptr<RouteItem::Item>>> items_;// the same way, if requested
+
+public:
+    TravelTimes(size_t source_count, size_t target_count, std::vector<std::optional<double>> total_times,
+                bool with_items, std::vector<std::vector<std::shared_ptr<RouteItem::Item>>> items, int request_id)
+        : Response(request_id), source_count_(source_count), target_count_(target_count),
+          total_times_(std::move(total_times)), with_items_(with_items), items_(std::move(items)) {}
+
+    void Write(Json::Writer &writer) const override {
+        writer.BeginObject();
+        writer.Key("request_id").Int(request_id);
+        writer.Key("total_times").BeginArray();
+        for (size_t i = 0; i != source_count_; ++i) {
+            writer.BeginArray();
+            for (size_t j = 0; j != target_count_; ++j) {
+                const auto &total_time = total_times_[i * target_count_ + j];
+                total_time ? writer.Double(*total_time) : writer.Null();
+            }
+            writer.EndArray();
+        }
+        writer.EndArray();
+        if (with_items_) {
+            writer.Key("items").BeginArray();
+            for (size_t i = 0; i != source_count_; ++i) {
+                writer.BeginArray();
+                for (size_t j = 0; j != target_count_; ++j) {
+                    if (!total_times_[i * target_count_ + j]) {
+                        writer.Null();
+                        continue;
+                    }
+                    writer.BeginArray();
+                    for (const auto &item_ptr : items_[i * target_count_ + j])
+                        item_ptr->Write(writer);
+                    writer.EndArray();
+                }
+                writer.EndArray();
             }
+            writer.EndArray();
         }
-        os << "    }";
-        return os;
+        writer.EndObject();
     }
 };
@@ -0,0 +1,508 @@
+#pragma once
+
+#include "graph.h"
+#include "routing_engine.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+    struct AStarSettings {
+        size_t landmark_count = 16;// 0 leaves only the distance bound
+    };
+
+    // Goal-directed router: every route is an A* search from the source,
+    // guided by a lower bound on the weight left to the target. Nothing but
+    // the bound is precomputed, so memory is O(landmarks * V).
+    //
+    // Two bounds are combined, the larger one wins:
+    // - distance: `distance` is any metric on the vertices (e.g. the
+    //   great-circle distance between the stops they are at). The constructor
+    //   finds the smallest weight per unit of distance over all the edges,
+    //   which turns the distance to the target into a lower bound;
+    // - landmarks (ALT): for a few vertices L spread over the graph the
+    //   weights from L and to L are known for every vertex, and the triangle
+    //   inequality gives d(v, t) >= d(L, t) - d(L, v) and d(v, t) >= d(v, L) - d(t, L).
+    //   Landmarks are shared out between the weakly connected components by
+    //   size and picked farthest first within each.
+    // Both bounds are consistent, so a vertex is final once settled and the
+    // search stops as soon as it settles the target.
+    //
+    // The bounds lead to a single target, so a weight matrix runs a plain
+    // Dijkstra per source instead, until it has settled every target.
+    //
+    // Update computes the bounds again: landmark weights must be exact.
+    template <typename Weight>
+    class AStarRouter : public RoutingEngine<Weight> {
+    private:
+        using Graph = DirectedWeightedGraph<Weight>;
+        using Base = RoutingEngine<Weight>;
+
+    public:
+        using Distance = std::function<double(VertexId, VertexId)>;
+
+        // `distance` must stay valid, and cover new vertices, across Update
+        explicit AStarRouter(const Graph& graph, AStarSettings settings = {}, Distance distance = {});
+
+        using typename Base::RouteId;
+        using typename Base::RouteInfo;
+
+        std::optional<Weight> FindRoute(VertexId from, VertexId to, std::vector<EdgeId>& edges) const override;
+        void FindWeightMatrix(std::span<const VertexId> sources, std::span<const VertexId> targets,
+                              std::span<std::optional<Weight>> weights) const override;
+        void Update(std::span<const EdgeId> added, std::span<const EdgeId> removed) override;
+        size_t GetMemoryUsage() const override;
+
+        // Landmark weights, the reversed graph and one search space
+        static size_t EstimateMemoryUsage(size_t vertex_count, size_t edge_count, AStarSettings settings) {
+            return vertex_count * (2 * settings.landmark_count * sizeof(Weight) + sizeof(EdgeId))
+                   + edge_count * sizeof(EdgeId)
+                   + vertex_count * (2 * sizeof(Weight) + sizeof(EdgeId));
+        }
+
+    private:
+        static constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max();
+        static constexpr Weight INFINITE_WEIGHT = std::numeric_limits<Weight>::infinity();
+
+        using QueueItem = std::pair<Weight, VertexId>;
+
+        // Per-query scratch, reused across queries
+        struct SearchSpace {
+            std::vector<Weight> weights;
+            std::vector<Weight> bounds;// to the target, computed on first reach
+            std::vector<EdgeId> prev_edges;
+            std::vector<VertexId> touched;
+            std::vector<QueueItem> queue;
+
+            explicit SearchSpace(size_t vertex_count);
+            size_t GetMemoryUsage() const;
+        };
+
+        const Graph& graph_;
+        AStarSettings settings_;
+        Distance distance_;
+        size_t vertex_count_ = 0;
+        // lower bound on the weight of an edge per unit of distance, 0 without a metric
+        double weight_per_distance_ = 0;
+        // edges entering every vertex, in compressed sparse row form
+        std::vector<EdgeId> reverse_offsets_, reverse_edges_;
+        std::vector<VertexId> landmarks_;
+        // per vertex, then per landmark: the weight from the landmark, then to it
+        std::vector<Weight> landmark_weights_;
+
+        mutable std::mutex spaces_mutex_;
+        mutable std::vector<std::unique_ptr<SearchSpace>> spaces_;
+
+        void Prepare();
+        void BuildReverseGraph();
+        void FindWeightPerDistance();
+        void PlaceLandmarks();
+        // Single-source weights over the graph or, if `reverse`, over its reversal
+        std::vector<Weight> ComputeWeights(VertexId source, bool reverse) const;
+        Weight GetBound(VertexId vertex, VertexId target) const;
+
+        std::unique_ptr<SearchSpace> AcquireSpace() const;
+        void ReleaseSpace(std::unique_ptr<SearchSpace> space) const;
+    };
+
+
+    template <typename Weight>
+    AStarRouter<Weight>::AStarRouter(const Graph& graph, AStarSettings settings, Distance distance)
+            : graph_(graph),
+              settings_(settings),
+              distance_(std::move(distance))
+    {
+        Prepare();
+    }
+
+    template <typename Weight>
+    void AStarRouter<Weight>::Update(std::span<const EdgeId>, std::span<const EdgeId>) {
+        {
+            std::lock_guard lock(spaces_mutex_);
+            spaces_.clear();
+        }
+        Prepare();
+    }
+
+    template <typename Weight>
+    void AStarRouter<Weight>::Prepare() {
+        vertex_count_ = graph_.GetVertexCount();
+        BuildReverseGraph();
+        FindWeightPerDistance();
+        PlaceLandmarks();
+    }
+
+    template <typename Weight>
+    void AStarRouter<Weight>::BuildReverseGraph() {
+        reverse_offsets_.assign(vertex_count_ + 1, 0);
+        for (EdgeId edge_id = 0; edge_id != graph_.GetEdgeCount(); ++edge_id) {
+            if (const auto& edge = graph_.GetEdge(edge_id); !IsRemoved(edge)) {
+                ++reverse_offsets_[edge.to + 1];
+            }
+        }
+        for (VertexId vertex = 0; vertex != vertex_count_; ++vertex) {
+            reverse_offsets_[vertex + 1] += reverse_offsets_[vertex];
+        }
+        reverse_edges_.resize(reverse_offsets_.back());
+        std::vector<EdgeId> next(reverse_offsets_.begin(), reverse_offsets_.end() - 1);
+        for (EdgeId edge_id = 0; edge_id != graph_.GetEdgeCount(); ++edge_id) {
+            if (const auto& edge = graph_.GetEdge(edge_id); !IsRemoved(edge)) {
+                reverse_edges_[next[edge.to]++] = edge_id;
+            }
+        }
+    }
+
+    template <typename Weight>
+    void AStarRouter<Weight>::FindWeightPerDistance() {
+        weight_per_distance_ = 0;
+        if (!distance_) {
+            return;
+        }
+        double res = std::numeric_limits<double>::infinity();
+        for (EdgeId edge_id = 0; edge_id != graph_.GetEdgeCount(); ++edge_id) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            if (IsRemoved(edge)) {
+                continue;
+            }
+            if (const double distance = distance_(edge.from, edge.to); distance > 0) {
+                res = std::min(res, static_cast<double>(edge.weight) / distance);
+            }
+        }
+        // a little slack for the rounding of the metric
+        weight_per_distance_ = std::isinf(res) ? 0 : res * (1 - 1e-9);
+    }
+
+    template <typename Weight>
+    void AStarRouter<Weight>::PlaceLandmarks() {
+        landmarks_.clear();
+        const size_t stride = 2 * settings_.landmark_count;
+        landmark_weights_.assign(vertex_count_ * stride, INFINITE_WEIGHT);
+
+        // Weakly connected components, vertices without edges left out. A
+        // search never leaves its component, so a small one is cheap to
+        // search without landmarks, and a landmark anywhere else tells that
+        // the target is out of reach.
+        std::vector<VertexId> roots(vertex_count_);
+        std::iota(roots.begin(), roots.end(), 0);
+        const auto find_root = [&roots](VertexId vertex) {
+            while (roots[vertex] != vertex) {
+                vertex = roots[vertex] = roots[roots[vertex]];
+            }
+            return vertex;
+        };
+        std::vector<bool> connected(vertex_count_);
+        for (EdgeId edge_id = 0; edge_id != graph_.GetEdgeCount(); ++edge_id) {
+            if (const auto& edge = graph_.GetEdge(edge_id); !IsRemoved(edge)) {
+                connected[edge.from] = connected[edge.to] = true;
+                roots[find_root(edge.from)] = find_root(edge.to);
+            }
+        }
+        std::vector<std::vector<VertexId>> components;
+        std::vector<size_t> component_ids(vertex_count_, NO_EDGE);
+        size_t connected_count = 0;
+        for (VertexId vertex = 0; vertex != vertex_count_; ++vertex) {
+            if (!connected[vertex]) {
+                continue;
+            }
+            auto& id = component_ids[find_root(vertex)];
+            if (id == NO_EDGE) {
+                id = components.size();
+                components.emplace_back();
+            }
+            components[id].push_back(vertex);
+            ++connected_count;
+        }
+
+        // landmarks in proportion to the component sizes, what rounding
+        // leaves to the largest components
+        std::sort(components.begin(), components.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.size() > rhs.size();
+        });
+        std::vector<size_t> quotas(components.size());
+        size_t left = settings_.landmark_count;
+        for (size_t id = 0; id != components.size(); ++id) {
+            quotas[id] = settings_.landmark_count * components[id].size() / connected_count;
+            left -= quotas[id];
+        }
+        for (size_t id = 0; left != 0 && id != components.size(); ++id, --left) {
+            ++quotas[id];
+        }
+
+        // Farthest first within a component: the next landmark is the vertex
+        // with the heaviest round trip to the closest landmark so far, or,
+        // for the first one, the farthest from an arbitrary vertex
+        std::vector<Weight> coverage;
+        for (size_t id = 0; id != components.size(); ++id) {
+            const auto& vertices = components[id];
+            for (size_t placed = 0; placed != quotas[id]; ++placed) {
+                if (placed == 0) {
+                    coverage = ComputeWeights(vertices.front(), false);
+                }
+                const VertexId landmark = *std::max_element(vertices.begin(), vertices.end(),
+                                                            [&coverage](VertexId lhs, VertexId rhs) {
+                                                                return coverage[lhs] < coverage[rhs];
+                                                            });
+                if (placed != 0 && coverage[landmark] == 0) {
+                    break;// every vertex is as close to a landmark as can be
+                }
+                const size_t slot = 2 * landmarks_.size();
+                landmarks_.push_back(landmark);
+                const auto from_landmark = ComputeWeights(landmark, false);
+                const auto to_landmark = ComputeWeights(landmark, true);
+                for (const VertexId vertex : vertices) {
+                    landmark_weights_[vertex * stride + slot] = from_landmark[vertex];
+                    landmark_weights_[vertex * stride + slot + 1] = to_landmark[vertex];
+                    const Weight round_trip = from_landmark[vertex] + to_landmark[vertex];
+                    coverage[vertex] = placed == 0 ? round_trip : std::min(coverage[vertex], round_trip);
+                }
+            }
+        }
+    }
+
+    template <typename Weight>
+    std::vector<Weight> AStarRouter<Weight>::ComputeWeights(VertexId source, bool reverse) const {
+        std::vector<Weight> weights(vertex_count_, INFINITE_WEIGHT);
+        std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<>> queue;
+        const auto relax = [&](VertexId vertex, Weight weight) {
+            if (weight < weights[vertex]) {
+                weights[vertex] = weight;
+                queue.emplace(weight, vertex);
+            }
+        };
+        relax(source, 0);
+        while (!queue.empty()) {
+            const auto [weight, vertex] = queue.top();
+            queue.pop();
+            if (weight > weights[vertex]) {
+                continue;
+            }
+            if (reverse) {
+                for (EdgeId i = reverse_offsets_[vertex]; i != reverse_offsets_[vertex + 1]; ++i) {
+                    const auto& edge = graph_.GetEdge(reverse_edges_[i]);
+                    relax(edge.from, weight + edge.weight);
+                }
+            } else {
+                for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+                    if (const auto& edge = graph_.GetEdge(edge_id); !IsRemoved(edge)) {
+                        relax(edge.to, weight + edge.weight);
+                    }
+                }
+            }
+        }
+        return weights;
+    }
+
+    template <typename Weight>
+    Weight AStarRouter<Weight>::GetBound(VertexId vertex, VertexId target) const {
+        Weight res = 0;
+        if (weight_per_distance_ > 0) {
+            res = static_cast<Weight>(weight_per_distance_ * distance_(vertex, target));
+        }
+        const size_t stride = 2 * settings_.landmark_count;
+        const Weight* vertex_weights = landmark_weights_.data() + vertex * stride;
+        const Weight* target_weights = landmark_weights_.data() + target * stride;
+        for (size_t slot = 0; slot != 2 * landmarks_.size(); slot += 2) {
+            // an infinite weight on one side only means the target is out of reach:
+            // L reaches the vertex but not the target, or the target reaches L
+            // but the vertex does not
+            const Weight from_landmark = vertex_weights[slot], target_from_landmark = target_weights[slot];
+            if (!std::isinf(target_from_landmark)) {
+                if (!std::isinf(from_landmark)) {
+                    res = std::max(res, target_from_landmark - from_landmark);
+                }
+            } else if (!std::isinf(from_landmark)) {
+                return INFINITE_WEIGHT;
+            }
+            const Weight to_landmark = vertex_weights[slot + 1], target_to_landmark = target_weights[slot + 1];
+            if (!std::isinf(to_landmark)) {
+                if (!std::isinf(target_to_landmark)) {
+                    res = std::max(res, to_landmark - target_to_landmark);
+                }
+            } else if (!std::isinf(target_to_landmark)) {
+                return INFINITE_WEIGHT;
+            }
+        }
+        return res;
+    }
+
+    template <typename Weight>
+    std::optional<Weight>
+    AStarRouter<Weight>::FindRoute(VertexId from, VertexId to, std::vector<EdgeId>& edges) const {
+        edges.clear();
+        if (from >= vertex_count_ || to >= vertex_count_) {
+            return std::nullopt;
+        }
+        auto space = AcquireSpace();
+        auto& weights = space->weights;
+        auto& bounds = space->bounds;
+        auto& queue = space->queue;
+        // queued by weight so far plus the bound on the rest
+        const auto reach = [&](VertexId vertex, Weight weight, EdgeId prev_edge) {
+            if (std::isinf(weights[vertex])) {
+                space->touched.push_back(vertex);
+                bounds[vertex] = GetBound(vertex, to);
+            }
+            weights[vertex] = weight;
+            space->prev_edges[vertex] = prev_edge;
+            if (!std::isinf(bounds[vertex])) {
+                queue.emplace_back(weight + bounds[vertex], vertex);
+                std::push_heap(queue.begin(), queue.end(), std::greater<>{});
+            }
+        };
+        reach(from, 0, NO_EDGE);
+
+        bool found = false;
+        while (!queue.empty()) {
+            std::pop_heap(queue.begin(), queue.end(), std::greater<>{});
+            const auto [key, vertex] = queue.back();
+            queue.pop_back();
+            if (key > weights[vertex] + bounds[vertex]) {
+                continue;
+            }
+            if (vertex == to) {
+                found = true;
+                break;
+            }
+            for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+                const auto& edge = graph_.GetEdge(edge_id);
+                assert(edge.weight >= 0);
+                if (!IsRemoved(edge) && weights[vertex] + edge.weight < weights[edge.to]) {
+                    reach(edge.to, weights[vertex] + edge.weight, edge_id);
+                }
+            }
+        }
+
+        std::optional<Weight> res;
+        if (found) {
+            for (EdgeId edge_id = space->prev_edges[to]; edge_id != NO_EDGE;
+                 edge_id = space->prev_edges[graph_.GetEdge(edge_id).from]) {
+                edges.push_back(edge_id);
+            }
+            std::reverse(edges.begin(), edges.end());
+            res = weights[to];
+        }
+
+        for (const VertexId vertex : space->touched) {
+            weights[vertex] = INFINITE_WEIGHT;
+        }
+        space->touched.clear();
+        queue.clear();
+        ReleaseSpace(std::move(space));
+        return res;
+    }
+
+    template <typename Weight>
+    void AStarRouter<Weight>::FindWeightMatrix(std::span<const VertexId> sources, std::span<const VertexId> targets,
+                                               std::span<std::optional<Weight>> weights) const {
+        std::fill(weights.begin(), weights.end(), std::nullopt);
+        // (vertex, column) of every target, sorted to look up settled vertices
+        std::vector<std::pair<VertexId, size_t>> columns;
+        for (size_t column = 0; column != targets.size(); ++column) {
+            if (targets[column] < vertex_count_) {
+                columns.emplace_back(targets[column], column);
+            }
+        }
+        std::sort(columns.begin(), columns.end());
+
+        auto space = AcquireSpace();
+        auto& vertex_weights = space->weights;
+        auto& queue = space->queue;
+        const auto reach = [&](VertexId vertex, Weight weight) {
+            if (std::isinf(vertex_weights[vertex])) {
+                space->touched.push_back(vertex);
+            }
+            vertex_weights[vertex] = weight;
+            queue.emplace_back(weight, vertex);
+            std::push_heap(queue.begin(), queue.end(), std::greater<>{});
+        };
+        for (size_t row = 0; row != sources.size(); ++row) {
+            if (sources[row] >= vertex_count_) {
+                continue;
+            }
+            reach(sources[row], 0);
+            for (size_t targets_left = columns.size(); targets_left != 0 && !queue.empty();) {
+                std::pop_heap(queue.begin(), queue.end(), std::greater<>{});
+                const auto [weight, vertex] = queue.back();
+                queue.pop_back();
+                if (weight > vertex_weights[vertex]) {
+                    continue;
+                }
+                for (auto it = std::lower_bound(columns.begin(), columns.end(), std::pair{vertex, size_t{0}});
+                     it != columns.end() && it->first == vertex; ++it) {
+                    weights[row * targets.size() + it->second] = weight;
+                    --targets_left;
+                }
+                for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+                    const auto& edge = graph_.GetEdge(edge_id);
+                    if (!IsRemoved(edge) && weight + edge.weight < vertex_weights[edge.to]) {
+                        reach(edge.to, weight + edge.weight);
+                    }
+                }
+            }
+            for (const VertexId vertex : space->touched) {
+                vertex_weights[vertex] = INFINITE_WEIGHT;
+            }
+            space->touched.clear();
+            queue.clear();
+        }
+        ReleaseSpace(std::move(space));
+    }
+
+    template <typename Weight>
+    AStarRouter<Weight>::SearchSpace::SearchSpace(size_t vertex_count)
+            : weights(vertex_count, INFINITE_WEIGHT),
+              bounds(vertex_count),
+              prev_edges(vertex_count)
+    {
+    }
+
+    template <typename Weight>
+    size_t AStarRouter<Weight>::SearchSpace::GetMemoryUsage() const {
+        return (weights.capacity() + bounds.capacity()) * sizeof(Weight) + prev_edges.capacity() * sizeof(EdgeId)
+               + touched.capacity() * sizeof(VertexId) + queue.capacity() * sizeof(QueueItem);
+    }
+
+    template <typename Weight>
+    std::unique_ptr<typename AStarRouter<Weight>::SearchSpace>
+    AStarRouter<Weight>::AcquireSpace() const {
+        {
+            std::lock_guard lock(spaces_mutex_);
+            if (!spaces_.empty()) {
+                auto res = std::move(spaces_.back());
+                spaces_.pop_back();
+                return res;
+            }
+        }
+        return std::make_unique<SearchSpace>(vertex_count_);
+    }
+
+    template <typename Weight>
+    void AStarRouter<Weight>::ReleaseSpace(std::unique_ptr<SearchSpace> space) const {
+        std::lock_guard lock(spaces_mutex_);
+        spaces_.push_back(std::move(space));
+    }
+
+    template <typename Weight>
+    size_t AStarRouter<Weight>::GetMemoryUsage() const {
+        size_t res = (reverse_offsets_.capacity() + reverse_edges_.capacity()) * sizeof(EdgeId)
+                     + landmarks_.capacity() * sizeof(VertexId) + landmark_weights_.capacity() * sizeof(Weight);
+        std::lock_guard lock(spaces_mutex_);
+        for (const auto& space : spaces_) {
+            res += space->GetMemoryUsage();
+        }
+        return res;
+    }
+
+}
@@ -0,0 +1,217 @@
+#include "city_generator.h"
+#include "json_arena.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "requests.h"
+#include "route_manager.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    using Clock = chrono::steady_clock;
+
+    double Seconds(Clock::duration duration) {
+        return chrono::duration<double>(duration).count();
+    }
+
+    // Runs `phase` and adds its duration to `phases`
+    template<typename F>
+    auto Time(vector<pair<string_view, double>> &phases, string_view name, F phase) {
+        const auto start = Clock::now();
+        if constexpr (is_void_v<decltype(phase())>) {
+            phase();
+            phases.emplace_back(name, Seconds(Clock::now() - start));
+        } else {
+            auto res = phase();
+            phases.emplace_back(name, Seconds(Clock::now() - start));
+            return res;
+        }
+    }
+
+    RoutingSettings MakeRoutingSettings(const CityConfig &config) {
+        // bus_velocity is in km/h, converted as main.cpp does
+        RoutingSettings res{static_cast<double>(config.wait_time), config.velocity * 16.66};
+        if (config.router == "on_demand")
+            res.router_mode = RouterMode::OnDemand;
+        else if (config.router == "contraction")
+            res.router_mode = RouterMode::Contraction;
+        else if (config.router == "a_star")
+            res.router_mode = RouterMode::AStar;
+        else if (config.router != "all_pairs")
+            throw invalid_argument("Unknown router " + config.router);
+        if (config.graph_model == "linear")
+            res.graph_model = GraphModel::Linear;
+        else if (config.graph_model != "stop_pairs")
+            throw invalid_argument("Unknown graph model " + config.graph_model);
+        res.a_star.landmark_count = config.landmark_count;
+        res.memory_budget = config.memory_budget_mb << 20;
+        return res;
+    }
+
+    // Latencies of the requests of one type, answered one at a time
+    struct RequestStats {
+        string_view type;
+        vector<Clock::duration> latencies;
+    };
+
+    double Percentile(vector<Clock::duration> &latencies, double share) {
+        const size_t idx = min(latencies.size() - 1, static_cast<size_t>(share * static_cast<double>(latencies.size())));
+        nth_element(latencies.begin(), latencies.begin() + static_cast<ptrdiff_t>(idx), latencies.end());
+        return chrono::duration<double, micro>(latencies[idx]).count();
+    }
+
+    void WriteRequestStats(Json::Writer &writer, RequestStats &stats) {
+        Clock::duration total{};
+        for (const auto latency : stats.latencies)
+            total += latency;
+        writer.Key(stats.type).BeginObject();
+        writer.Key("count").Int(static_cast<int64_t>(stats.latencies.size()));
+        writer.Key("seconds").Double(Seconds(total));
+        if (!stats.latencies.empty()) {
+            writer.Key("per_second").Double(static_cast<double>(stats.latencies.size()) / Seconds(total));
+            writer.Key("p50_us").Double(Percentile(stats.latencies, 0.5));
+            writer.Key("p99_us").Double(Percentile(stats.latencies, 0.99));
+            writer.Key("max_us").Double(chrono::duration<double, micro>(
+                    *max_element(stats.latencies.begin(), stats.latencies.end())).count());
+        }
+        writer.EndObject();
+    }
+
+    void Run(const CityConfig &config, ostream &output) {
+        vector<pair<string_view, double>> phases;
+
+        const string text = Time(phases, "generate", [&config] {
+            ostringstream city;
+            {
+                Json::Writer writer(city, Json::Writer::Style::Compact);
+                WriteCity(config, writer);
+            }
+            return std::move(city).str();
+        });
+
+        Json::ArenaDocument doc;
+        const Json::ArenaNode &root = Time(phases, "json_load", [&] { return cref(doc.Load(text)); });
+        const auto &base_requests = root.At(doc.FindKey("base_requests")).AsArray();
+        const auto &stat_requests = root.At(doc.FindKey("stat_requests")).AsArray();
+
+        RouteManager mg(MakeRoutingSettings(config));
+        Time(phases, "ingest", [&] {
+            for (const auto &update : base_requests)
+                mg.MakeUpdate(Requests::ParseUpdate(doc, update));
+        });
+        Time(phases, "finalize", [&] { mg.Finalize(); });
+        Time(phases, "graph_build", [&] { mg.PrepareGraph(); });
+        Time(phases, "router_build", [&] { mg.PrepareRouting(); });
+
+        const auto calls = Time(phases, "parse_stat_requests", [&] {
+            vector<Requests::StatRequest> res;
+            res.reserve(stat_requests.size());
+            for (const auto &call : stat_requests)
+                res.push_back(Requests::ParseStatRequest(doc, call));
+            return res;
+        });
+
+        RequestStats stats[] = {{"Bus", {}}, {"Stop", {}}, {"Route", {}}, {"Matrix", {}}};
+        vector<unique_ptr<Response>> responses;
+        responses.reserve(calls.size());
+        for (const auto &call : calls) {
+            const auto start = Clock::now();
+            responses.push_back(mg.MakeCall(call));
+            stats[static_cast<size_t>(call.type)].latencies.push_back(Clock::now() - start);
+        }
+
+        Time(phases, "serialize", [&] {
+            ostringstream sink;
+            Json::Writer writer(sink, Json::Writer::Style::Compact);
+            writer.BeginArray();
+            for (const auto &response : responses)
+                response->Write(writer);
+            writer.EndArray();
+        });
+        responses.clear();
+
+        ThreadPool pool(ThreadPool::DefaultThreadCount());
+        const auto parallel_start = Clock::now();
+        mg.MakeCalls(calls, pool);
+        const double parallel_seconds = Seconds(Clock::now() - parallel_start);
+
+        Json::Writer writer(output);
+        writer.BeginObject();
+        writer.Key("city").BeginObject();
+        writer.Key("seed").Int(static_cast<int64_t>(config.seed));
+        writer.Key("stops").Int(static_cast<int64_t>(config.stop_count));
+        writer.Key("buses").Int(static_cast<int64_t>(config.bus_count));
+        writer.Key("queries").Int(static_cast<int64_t>(config.query_count));
+        writer.Key("router").Text(config.router);
+        writer.Key("graph_model").Text(config.graph_model);
+        writer.Key("input_bytes").Int(static_cast<int64_t>(text.size()));
+        writer.EndObject();
+
+        // what the memory budget left of the configured routing
+        const auto &settings = mg.GetRoutingSettings();
+        writer.Key("routing").BeginObject();
+        const string_view router_names[] = {"all_pairs", "on_demand", "contraction", "a_star"};
+        writer.Key("router").String(router_names[static_cast<size_t>(settings.router_mode)]);
+        writer.Key("graph_model").String(settings.graph_model == GraphModel::Linear ? "linear" : "stop_pairs");
+        writer.Key("router_cache_size").Int(static_cast<int64_t>(settings.router_cache_size));
+        writer.EndObject();
+
+        writer.Key("phases_seconds").BeginObject();
+        for (const auto &[name, seconds] : phases)
+            writer.Key(name).Double(seconds);
+        writer.EndObject();
+
+        writer.Key("requests").BeginObject();
+        for (auto &request_stats : stats)
+            WriteRequestStats(writer, request_stats);
+        writer.EndObject();
+
+        writer.Key("parallel").BeginObject();
+        writer.Key("threads").Int(static_cast<int64_t>(pool.GetThreadCount()));
+        writer.Key("seconds").Double(parallel_seconds);
+        writer.Key("per_second").Double(static_cast<double>(calls.size()) / parallel_seconds);
+        writer.EndObject();
+
+        writer.Key("metrics");
+        Metrics::Write(writer);
+        writer.EndObject();
+    }
+}// namespace
+
+// Usage:
+//   route_manager_benchmark [--<option> <value>]...
+// Generates a city with generate_city's options, then times every phase of
+// serving it and prints a JSON report: phase durations, and per request type
+// the throughput and latency percentiles of answering requests one by one,
+// plus the throughput of answering them all on a thread pool, then the
+// metrics.h document with the memory estimates and usage.
+int main(int argc, char *argv[]) {
+    CityConfig config;
+    try {
+        for (int i = 1; i < argc; i += 2) {
+            const string_view arg = argv[i];
+            if (arg.substr(0, 2) != "--" || i + 1 == argc || !SetCityOption(config, arg.substr(2), argv[i + 1])) {
+                cerr << "Unknown option " << arg << '\n';
+                return 1;
+            }
+        }
+        Metrics::Enable();
+        Run(config, cout);
+    } catch (const exception &e) {
+        cerr << "An error occured: " << e.what() << '\n';
+        return 1;
+    }
+    cout << '\n';
+}
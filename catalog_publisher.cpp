@@ -0,0 +1,61 @@
+#include "catalog_publisher.h"
+
+#include "metrics.h"
+
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+CatalogPublisher::CatalogPublisher(shared_ptr<const RouteManager> initial) {
+    if (!initial)
+        throw invalid_argument("A publisher needs an initial snapshot");
+    initial->PrepareRouting();
+    current_.store(move(initial), memory_order_release);
+}
+
+void CatalogPublisher::MakeUpdate(const Requests::Update &update) {
+    std::lock_guard lock(draft_mutex_);
+    if (!draft_)
+        draft_ = Acquire()->CopyBase();
+    draft_->MakeUpdate(update);
+    ++pending_;
+}
+
+size_t CatalogPublisher::GetPendingUpdateCount() const {
+    std::lock_guard lock(draft_mutex_);
+    return pending_;
+}
+
+CatalogPublisher::Build CatalogPublisher::TakeDraft() {
+    std::lock_guard lock(draft_mutex_);
+    if (pending_ == 0)
+        return {};
+    pending_ = 0;
+    return {draft_->CopyBase(), ++taken_generation_};
+}
+
+shared_ptr<const RouteManager> CatalogPublisher::Complete(Build build) {
+    if (!build.base)
+        return Acquire();
+    {
+        const Metrics::Span timing(Metrics::Phase::Publish);
+        build.base->Finalize();
+        build.base->PrepareRouting();
+    }
+    shared_ptr<const RouteManager> snapshot = move(build.base);
+    std::lock_guard lock(publish_mutex_);
+    if (build.generation < published_generation_)
+        return Acquire();
+    published_generation_ = build.generation;
+    current_.store(snapshot, memory_order_release);
+    return snapshot;
+}
+
+shared_ptr<const RouteManager> CatalogPublisher::Publish() {
+    return Complete(TakeDraft());
+}
+
+future<shared_ptr<const RouteManager>> CatalogPublisher::PublishAsync() {
+    return async(launch::async, [this, build = TakeDraft()]() mutable { return Complete(move(build)); });
+}
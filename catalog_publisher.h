@@ -0,0 +1,64 @@
+#pragma once
+
+#include "requests.h"
+#include "route_manager.h"
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+
+// Serves stat requests from immutable snapshots while the base keeps changing.
+//
+// A snapshot is a RouteManager that is finalized, has its routing prepared
+// and is never changed again, so any number of threads may query it at once.
+// Readers take the current one with Acquire, a single atomic load, and keep
+// it for as long as they need: a snapshot that is replaced stays alive until
+// its last reader lets go of it.
+//
+// Updates go into a draft of the base, which nobody reads. Publish copies the
+// draft and builds the next snapshot from the copy, off to the side, then
+// swaps it in; the draft accepts new updates while that runs.
+class CatalogPublisher {
+public:
+    explicit CatalogPublisher(std::shared_ptr<const RouteManager> initial);
+
+    // The current snapshot. Responses made from it point into it, so it must
+    // be held until they are written.
+    std::shared_ptr<const RouteManager> Acquire() const { return current_.load(std::memory_order_acquire); }
+
+    // Queues an update for the next snapshot. Thread-safe.
+    void MakeUpdate(const Requests::Update &update);
+    size_t GetPendingUpdateCount() const;
+
+    // Builds a snapshot with every update queued so far, swaps it in and
+    // returns it; returns the current one when nothing is queued. Builds may
+    // run concurrently: a build that finishes after a newer one is dropped.
+    std::shared_ptr<const RouteManager> Publish();
+    // The same on a new thread. The updates are taken before it returns, so
+    // later ones wait for the next Publish. The publisher must outlive the
+    // returned future's completion.
+    std::future<std::shared_ptr<const RouteManager>> PublishAsync();
+
+private:
+    std::atomic<std::shared_ptr<const RouteManager>> current_;
+
+    // The draft is made from the current snapshot by the first update
+    mutable std::mutex draft_mutex_;
+    std::unique_ptr<RouteManager> draft_;
+    size_t pending_ = 0;
+    uint64_t taken_generation_ = 0;
+
+    // Orders the swaps
+    std::mutex publish_mutex_;
+    uint64_t published_generation_ = 0;
+
+    // A copy of the draft with the updates it holds, null when there are none
+    struct Build {
+        std::unique_ptr<RouteManager> base;
+        uint64_t generation = 0;
+    };
+    Build TakeDraft();
+    std::shared_ptr<const RouteManager> Complete(Build build);
+};
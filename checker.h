@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// Counts the checks of a check executable; failed ones are printed on stderr
+class Checker {
+public:
+    void Expect(bool ok, const std::string &what) {
+        ++count_;
+        if (!ok) {
+            ++failures_;
+            std::cerr << "FAILED: " << what << '\n';
+        }
+    }
+    size_t GetCount() const { return count_; }
+    size_t GetFailures() const { return failures_; }
+
+    // Prints the summary and returns the exit code
+    int Report() const {
+        std::cout << count_ - failures_ << " of " << count_ << " checks passed\n";
+        return failures_ == 0 ? 0 : 1;
+    }
+
+private:
+    size_t count_ = 0, failures_ = 0;
+};
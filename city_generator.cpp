@@ -0,0 +1,271 @@
+#include "city_generator.h"
+
+#include "Coordinates.h"
+#include "geo.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    // splitmix64: unlike the <random> distributions, its output is the same
+    // with every standard library
+    class Random {
+    public:
+        explicit Random(uint64_t seed) : state_(seed) {}
+
+        uint64_t Next() {
+            uint64_t x = (state_ += 0x9e3779b97f4a7c15ULL);
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+            return x ^ (x >> 31);
+        }
+        // Uniform in [0, bound)
+        size_t Below(size_t bound) { return static_cast<size_t>(Next() % bound); }
+        // Uniform in [0, 1)
+        double Unit() { return static_cast<double>(Next() >> 11) * 0x1.0p-53; }
+
+    private:
+        uint64_t state_;
+    };
+
+    const double STOP_SPACING = 300;// metres
+    const double BASE_LAT = 55.5, BASE_LON = 37.3;
+    const double METRES_PER_DEGREE = Geo::EARTH_RADIUS * 3.1415926535 / 180;
+
+    string StopName(size_t stop) { return "Stop " + to_string(stop); }
+    string BusName(size_t bus) { return "Bus " + to_string(bus); }
+
+    template<typename T>
+    T ParseNumber(string_view name, string_view value) {
+        T res{};
+        const auto [end, error] = from_chars(value.data(), value.data() + value.size(), res);
+        if (error != errc{} || end != value.data() + value.size())
+            throw invalid_argument("Bad value for --" + string(name) + ": " + string(value));
+        return res;
+    }
+
+    double ParseShare(string_view name, string_view value) {
+        const auto res = ParseNumber<double>(name, value);
+        if (!(res >= 0 && res <= 1))
+            throw invalid_argument("--" + string(name) + " must be between 0 and 1");
+        return res;
+    }
+
+    class CityBuilder {
+    public:
+        explicit CityBuilder(const CityConfig &config)
+            : config_(config), random_(config.seed),
+              grid_side_(static_cast<size_t>(ceil(sqrt(static_cast<double>(config.stop_count))))),
+              distances_(config.stop_count) {}
+
+        void Build() {
+            PlaceStops();
+            for (size_t bus = 0; bus != config_.bus_count; ++bus)
+                routes_.push_back(MakeRoute());
+        }
+
+        void Write(Json::Writer &writer) {
+            writer.BeginObject();
+            writer.Key("routing_settings").BeginObject();
+            writer.Key("bus_wait_time").Int(config_.wait_time);
+            writer.Key("bus_velocity").Int(config_.velocity);
+            writer.Key("router").Text(config_.router);
+            writer.Key("graph_model").Text(config_.graph_model);
+            if (config_.router == "a_star")
+                writer.Key("router_landmarks").Int(static_cast<int64_t>(config_.landmark_count));
+            if (config_.memory_budget_mb != 0)
+                writer.Key("memory_budget_mb").Int(static_cast<int64_t>(config_.memory_budget_mb));
+            writer.EndObject();
+
+            writer.Key("base_requests").BeginArray();
+            for (size_t stop = 0; stop != config_.stop_count; ++stop) {
+                writer.BeginObject();
+                writer.Key("type").String("Stop");
+                writer.Key("name").String(StopName(stop));
+                writer.Key("latitude").Double(coords_[stop].lat_);
+                writer.Key("longitude").Double(coords_[stop].lon_);
+                writer.Key("road_distances").BeginObject();
+                for (const auto &[to, meters] : distances_[stop])
+                    writer.Key(StopName(to)).Int(meters);
+                writer.EndObject();
+                writer.EndObject();
+            }
+            for (size_t bus = 0; bus != routes_.size(); ++bus) {
+                writer.BeginObject();
+                writer.Key("type").String("Bus");
+                writer.Key("name").String(BusName(bus));
+                writer.Key("stops").BeginArray();
+                for (const size_t stop : routes_[bus].stops)
+                    writer.String(StopName(stop));
+                writer.EndArray();
+                writer.Key("is_roundtrip").Bool(routes_[bus].is_roundtrip);
+                writer.EndObject();
+            }
+            writer.EndArray();
+
+            writer.Key("stat_requests").BeginArray();
+            for (size_t id = 0; id != config_.query_count; ++id)
+                WriteQuery(writer, id);
+            writer.EndArray();
+            writer.EndObject();
+        }
+
+    private:
+        struct Route {
+            vector<size_t> stops;
+            bool is_roundtrip;
+        };
+
+        const CityConfig &config_;
+        Random random_;
+        size_t grid_side_;
+        vector<Coordinates> coords_;
+        vector<vector<pair<size_t, int>>> distances_;// per stop, in the order they were set
+        vector<Route> routes_;
+
+        void PlaceStops() {
+            const double lat_step = STOP_SPACING / METRES_PER_DEGREE;
+            const double lon_step = lat_step / cos(BASE_LAT * 3.1415926535 / 180);
+            coords_.reserve(config_.stop_count);
+            for (size_t stop = 0; stop != config_.stop_count; ++stop) {
+                const double row = static_cast<double>(stop / grid_side_) + 0.8 * random_.Unit() - 0.4;
+                const double col = static_cast<double>(stop % grid_side_) + 0.8 * random_.Unit() - 0.4;
+                coords_.push_back({BASE_LAT + row * lat_step, BASE_LON + col * lon_step});
+            }
+        }
+
+        // A random neighbour on the grid (diagonals included), other than `avoid` if possible
+        size_t NextStop(size_t stop, size_t avoid) {
+            size_t candidates[8], count = 0;
+            const auto row = static_cast<ptrdiff_t>(stop / grid_side_), col = static_cast<ptrdiff_t>(stop % grid_side_);
+            const auto side = static_cast<ptrdiff_t>(grid_side_);
+            for (ptrdiff_t dr = -1; dr <= 1; ++dr) {
+                for (ptrdiff_t dc = -1; dc <= 1; ++dc) {
+                    const ptrdiff_t r = row + dr, c = col + dc;
+                    if ((dr == 0 && dc == 0) || r < 0 || c < 0 || c >= side)
+                        continue;
+                    const auto next = static_cast<size_t>(r * side + c);
+                    if (next < config_.stop_count && next != avoid)
+                        candidates[count++] = next;
+                }
+            }
+            if (count == 0)
+                return avoid;
+            return candidates[random_.Below(count)];
+        }
+
+        Route MakeRoute() {
+            const size_t length_span = config_.max_route_length - config_.min_route_length + 1;
+            const size_t length = config_.min_route_length + random_.Below(length_span);
+            Route route{{random_.Below(config_.stop_count)}, random_.Unit() < config_.roundtrip_share};
+            size_t previous = route.stops.front();
+            while (route.stops.size() < length) {
+                const size_t next = NextStop(route.stops.back(), previous);
+                if (next == route.stops.back())
+                    break;// a lone stop has no neighbours
+                previous = route.stops.back();
+                AddRoadDistance(previous, next);
+                route.stops.push_back(next);
+            }
+            if (route.is_roundtrip && route.stops.size() > 1) {
+                AddRoadDistance(route.stops.back(), route.stops.front());
+                route.stops.push_back(route.stops.front());
+            }
+            return route;
+        }
+
+        void AddRoadDistance(size_t from, size_t to) {
+            if (random_.Unit() >= config_.road_distance_share)
+                return;
+            auto &distances = distances_[from];
+            if (any_of(distances.begin(), distances.end(), [to](const auto &distance) { return distance.first == to; }))
+                return;
+            const double straight = Geo::Distance(Geo::ToUnitVector(coords_[from]), Geo::ToUnitVector(coords_[to]));
+            distances.emplace_back(to, static_cast<int>(ceil(straight * (1.1 + 0.4 * random_.Unit()))));
+        }
+
+        void WriteQuery(Json::Writer &writer, size_t id) {
+            const double kind = random_.Unit();
+            writer.BeginObject();
+            writer.Key("id").Int(static_cast<int64_t>(id));
+            if (kind < config_.route_query_share) {
+                writer.Key("type").String("Route");
+                writer.Key("from").String(StopName(random_.Below(config_.stop_count)));
+                writer.Key("to").String(StopName(random_.Below(config_.stop_count)));
+            } else if (kind < config_.route_query_share + config_.bus_query_share && config_.bus_count != 0) {
+                writer.Key("type").String("Bus");
+                writer.Key("name").String(BusName(random_.Below(config_.bus_count)));
+            } else if (kind < config_.route_query_share + config_.bus_query_share + config_.matrix_query_share) {
+                writer.Key("type").String("Matrix");
+                for (const string_view key : {"sources", "targets"}) {
+                    writer.Key(key).BeginArray();
+                    for (size_t i = 0; i != config_.matrix_size; ++i)
+                        writer.String(StopName(random_.Below(config_.stop_count)));
+                    writer.EndArray();
+                }
+            } else {
+                writer.Key("type").String("Stop");
+                writer.Key("name").String(StopName(random_.Below(config_.stop_count)));
+            }
+            writer.EndObject();
+        }
+    };
+}// namespace
+
+bool SetCityOption(CityConfig &config, string_view name, string_view value) {
+    if (name == "seed")
+        config.seed = ParseNumber<uint64_t>(name, value);
+    else if (name == "stops")
+        config.stop_count = ParseNumber<size_t>(name, value);
+    else if (name == "buses")
+        config.bus_count = ParseNumber<size_t>(name, value);
+    else if (name == "min-route")
+        config.min_route_length = ParseNumber<size_t>(name, value);
+    else if (name == "max-route")
+        config.max_route_length = ParseNumber<size_t>(name, value);
+    else if (name == "roundtrip-share")
+        config.roundtrip_share = ParseShare(name, value);
+    else if (name == "road-distance-share")
+        config.road_distance_share = ParseShare(name, value);
+    else if (name == "queries")
+        config.query_count = ParseNumber<size_t>(name, value);
+    else if (name == "route-share")
+        config.route_query_share = ParseShare(name, value);
+    else if (name == "bus-share")
+        config.bus_query_share = ParseShare(name, value);
+    else if (name == "matrix-share")
+        config.matrix_query_share = ParseShare(name, value);
+    else if (name == "matrix-size")
+        config.matrix_size = ParseNumber<size_t>(name, value);
+    else if (name == "wait-time")
+        config.wait_time = ParseNumber<int>(name, value);
+    else if (name == "velocity")
+        config.velocity = ParseNumber<int>(name, value);
+    else if (name == "router")
+        config.router = value;
+    else if (name == "graph-model")
+        config.graph_model = value;
+    else if (name == "landmarks")
+        config.landmark_count = ParseNumber<size_t>(name, value);
+    else if (name == "memory-budget-mb")
+        config.memory_budget_mb = ParseNumber<size_t>(name, value);
+    else
+        return false;
+    return true;
+}
+
+void WriteCity(const CityConfig &config, Json::Writer &writer) {
+    if (config.stop_count == 0)
+        throw invalid_argument("A city needs at least one stop");
+    if (config.min_route_length < 2 || config.min_route_length > config.max_route_length)
+        throw invalid_argument("Route lengths must satisfy 2 <= min <= max");
+    CityBuilder builder(config);
+    builder.Build();
+    builder.Write(writer);
+}
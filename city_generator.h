@@ -0,0 +1,39 @@
+#pragma once
+
+#include "json_writer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Synthetic cities for benchmarks: a complete input document (routing
+// settings, base requests and stat requests) that only depends on the config,
+// so a seed always gives the same city on every platform.
+//
+// Stops lie on a jittered grid with about 300 m between neighbours, so the
+// city grows with the stop count instead of getting denser. Every bus route is
+// a random walk over neighbouring stops; a roundtrip one ends where it began.
+// Most segments get a road distance somewhat longer than the great-circle one.
+struct CityConfig {
+    uint64_t seed = 1;
+    size_t stop_count = 1000;
+    size_t bus_count = 100;
+    size_t min_route_length = 5, max_route_length = 20;// stops per route
+    double roundtrip_share = 0.5;
+    double road_distance_share = 0.8;// segments with an explicit road distance
+    size_t query_count = 10000;
+    double route_query_share = 0.5, bus_query_share = 0.25;// the rest are Stop queries
+    double matrix_query_share = 0;// taken from the Stop queries
+    size_t matrix_size = 10;      // sources, and as many targets, per Matrix query
+    int wait_time = 6, velocity = 40;// minutes, km/h
+    std::string router = "all_pairs", graph_model = "stop_pairs";
+    size_t memory_budget_mb = 0;// 0 leaves it out of the routing settings
+    size_t landmark_count = 16;// only written for the a_star router
+};
+
+// Sets the option `--name value`; false if there is no such option. Throws
+// std::invalid_argument for a malformed value.
+bool SetCityOption(CityConfig &config, std::string_view name, std::string_view value);
+
+void WriteCity(const CityConfig &config, Json::Writer &writer);
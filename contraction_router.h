@@ -0,0 +1,618 @@
+#pragma once
+
+#include "graph.h"
+#include "routing_engine.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+    // Contraction hierarchies router. The constructor contracts the vertices
+    // one by one, cheapest first: fewest shortcuts added for the edges
+    // removed, spread over the graph to keep the hierarchy shallow. Every pair
+    // of edges u -> v -> w through the contracted vertex v becomes a shortcut
+    // u -> w, unless a bounded local Dijkstra finds a path from u to w
+    // avoiding v that is no longer (a witness). The order of contraction
+    // ranks the vertices.
+    //
+    // A route is then found by a bidirectional Dijkstra that only goes up the
+    // ranks: forwards from the source over edges to higher ranked vertices,
+    // backwards from the target over edges from higher ranked ones. The two
+    // searches meet at the highest vertex of the shortest route, and only
+    // explore a few hundred vertices on road-like graphs. Shortcuts are
+    // unpacked recursively into the graph edges they stand for.
+    //
+    // A weight matrix runs the upward searches to the end instead, once per
+    // source and once per target. Every route is the lightest sum of a
+    // forward and a backward weight at a vertex both searches reached, so
+    // the vertices reached are sorted and the two lists merged.
+    //
+    // Parallel edges are merged into the lightest one, and removed edges and
+    // loops are left out. Update contracts the whole graph again: a changed
+    // edge may invalidate shortcuts anywhere above it.
+    template <typename Weight>
+    class ContractionRouter : public RoutingEngine<Weight> {
+    private:
+        using Graph = DirectedWeightedGraph<Weight>;
+        using Base = RoutingEngine<Weight>;
+
+    public:
+        explicit ContractionRouter(const Graph& graph);
+
+        using typename Base::RouteId;
+        using typename Base::RouteInfo;
+
+        std::optional<Weight> FindRoute(VertexId from, VertexId to, std::vector<EdgeId>& edges) const override;
+        // One upward search per source and per target, joined where they meet
+        void FindWeightMatrix(std::span<const VertexId> sources, std::span<const VertexId> targets,
+                              std::span<std::optional<Weight>> weights) const override;
+        void Update(std::span<const EdgeId> added, std::span<const EdgeId> removed) override;
+        size_t GetMemoryUsage() const override;
+
+        // Peak bytes while contracting, assuming about as many shortcuts as
+        // edges: the unpacking table, both working adjacency lists and the
+        // final search graphs
+        static size_t EstimateMemoryUsage(size_t vertex_count, size_t edge_count) {
+            return 2 * edge_count * (sizeof(Link) + 3 * sizeof(Arc))
+                   + vertex_count * (2 * sizeof(std::vector<Arc>) + 2 * sizeof(EdgeId) + sizeof(Weight));
+        }
+
+    private:
+        static constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max();
+        static constexpr VertexId NO_VERTEX = std::numeric_limits<VertexId>::max();
+        static constexpr Weight INFINITE_WEIGHT = std::numeric_limits<Weight>::infinity();
+        // Vertices a witness search may settle before it gives up and the
+        // shortcut is kept; an extra shortcut costs query time, never correctness
+        static constexpr size_t WITNESS_SETTLE_LIMIT = 500;
+
+        // An edge of the hierarchy: the graph edge `first` if `second` is
+        // NO_EDGE, otherwise a shortcut for the hierarchy edges `first` and
+        // `second` in a row
+        struct Link {
+            EdgeId first;
+            EdgeId second;
+        };
+
+        // A hierarchy edge as seen from the vertex it is stored at
+        struct Arc {
+            VertexId other;
+            Weight weight;
+            EdgeId link;
+        };
+
+        using QueueItem = std::pair<Weight, VertexId>;
+
+        // Working state of the contraction, dropped once the search graphs are built
+        struct Contraction {
+            // edges between the vertices not contracted yet
+            std::vector<std::vector<Arc>> out, in;
+            std::vector<size_t> contracted_neighbours;
+            std::vector<size_t> depths;// longest chain of contracted vertices below
+            // arcs of every contracted vertex to higher ranked ones
+            std::vector<std::vector<Arc>> up, down;
+            // witness search scratch
+            std::vector<Weight> weights;
+            std::vector<bool> targets;
+            std::vector<VertexId> touched;
+            std::vector<QueueItem> queue;
+            struct Shortcut {
+                VertexId from, to;
+                Weight weight;
+                EdgeId first, second;
+            };
+            std::vector<Shortcut> shortcuts;
+        };
+
+        // Per-query scratch, reused across queries: index 0 is the forward
+        // search, 1 the backward one
+        struct SearchSpace {
+            std::vector<Weight> weights[2];
+            std::vector<VertexId> prev_vertices[2];
+            std::vector<EdgeId> prev_links[2];
+            std::vector<QueueItem> queues[2];
+            std::vector<VertexId> touched;
+            std::vector<EdgeId> links;// route in hierarchy edges, then the unpacking stack
+
+            explicit SearchSpace(size_t vertex_count);
+            size_t GetMemoryUsage() const;
+        };
+
+        // A vertex an upward search settled, from the source or target `end`
+        struct Reached {
+            VertexId vertex;
+            size_t end;
+            Weight weight;
+        };
+
+        const Graph& graph_;
+        std::vector<Link> links_;
+        // up_arcs_ of a vertex lead to higher ranked vertices; down_arcs_ of a
+        // vertex come from higher ranked vertices, for the backward search
+        std::vector<EdgeId> up_offsets_, down_offsets_;
+        std::vector<Arc> up_arcs_, down_arcs_;
+
+        mutable std::mutex spaces_mutex_;
+        mutable std::vector<std::unique_ptr<SearchSpace>> spaces_;
+
+        void Contract();
+        void AddInitialArcs(Contraction& state);
+        void AddArc(Contraction& state, VertexId from, VertexId to, Weight weight, Link link);
+        // Fills state.shortcuts with those contracting `vertex` needs and returns its priority
+        int64_t FindShortcuts(Contraction& state, VertexId vertex) const;
+        void ContractVertex(Contraction& state, VertexId vertex);
+        static void BuildSearchGraph(std::vector<std::vector<Arc>>& arcs, std::vector<EdgeId>& offsets, std::vector<Arc>& flat);
+
+        std::span<const Arc> GetArcs(size_t direction, VertexId vertex) const;
+        std::unique_ptr<SearchSpace> AcquireSpace() const;
+        void ReleaseSpace(std::unique_ptr<SearchSpace> space) const;
+        // Appends every vertex the upward search from `start` settles to `reached`
+        void SearchUp(SearchSpace& space, size_t direction, VertexId start, size_t end, std::vector<Reached>& reached) const;
+        void Unpack(std::vector<EdgeId>& links, std::vector<EdgeId>& edges) const;
+    };
+
+
+    template <typename Weight>
+    ContractionRouter<Weight>::ContractionRouter(const Graph& graph)
+            : graph_(graph)
+    {
+        Contract();
+    }
+
+    template <typename Weight>
+    void ContractionRouter<Weight>::Update(std::span<const EdgeId>, std::span<const EdgeId>) {
+        {
+            std::lock_guard lock(spaces_mutex_);
+            spaces_.clear();
+        }
+        Contract();
+    }
+
+    template <typename Weight>
+    void ContractionRouter<Weight>::Contract() {
+        const size_t vertex_count = graph_.GetVertexCount();
+        Contraction state{
+                std::vector<std::vector<Arc>>(vertex_count), std::vector<std::vector<Arc>>(vertex_count),
+                std::vector<size_t>(vertex_count), std::vector<size_t>(vertex_count),
+                std::vector<std::vector<Arc>>(vertex_count), std::vector<std::vector<Arc>>(vertex_count),
+                std::vector<Weight>(vertex_count, INFINITE_WEIGHT), std::vector<bool>(vertex_count), {}, {}, {}};
+        links_.clear();
+        AddInitialArcs(state);
+
+        // Lazy updates: a popped vertex gets its priority recomputed and is
+        // only contracted if it is still no worse than the next one
+        using Candidate = std::pair<int64_t, VertexId>;
+        std::priority_queue<Candidate, std::vector<Candidate>, std::greater<>> candidates;
+        for (VertexId vertex = 0; vertex != vertex_count; ++vertex) {
+            candidates.emplace(FindShortcuts(state, vertex), vertex);
+        }
+        while (!candidates.empty()) {
+            const VertexId vertex = candidates.top().second;
+            candidates.pop();
+            const int64_t priority = FindShortcuts(state, vertex);
+            if (!candidates.empty() && priority > candidates.top().first) {
+                candidates.emplace(priority, vertex);
+                continue;
+            }
+            ContractVertex(state, vertex);
+        }
+
+        state.out = {};
+        state.in = {};
+        BuildSearchGraph(state.up, up_offsets_, up_arcs_);
+        BuildSearchGraph(state.down, down_offsets_, down_arcs_);
+        links_.shrink_to_fit();
+    }
+
+    template <typename Weight>
+    void ContractionRouter<Weight>::AddInitialArcs(Contraction& state) {
+        for (EdgeId edge_id = 0; edge_id != graph_.GetEdgeCount(); ++edge_id) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            assert(IsRemoved(edge) || edge.weight >= 0);
+            if (!IsRemoved(edge) && edge.from != edge.to) {
+                state.out[edge.from].push_back({edge.to, edge.weight, edge_id});
+            }
+        }
+        // only the lightest of parallel edges, the first of equal ones
+        for (VertexId from = 0; from != state.out.size(); ++from) {
+            auto arcs = std::move(state.out[from]);
+            std::stable_sort(arcs.begin(), arcs.end(), [](const Arc& lhs, const Arc& rhs) {
+                return lhs.other != rhs.other ? lhs.other < rhs.other : lhs.weight < rhs.weight;
+            });
+            state.out[from].clear();
+            for (size_t i = 0; i != arcs.size(); ++i) {
+                if (i == 0 || arcs[i].other != arcs[i - 1].other) {
+                    const EdgeId link_id = links_.size();
+                    links_.push_back({arcs[i].link, NO_EDGE});
+                    state.out[from].push_back({arcs[i].other, arcs[i].weight, link_id});
+                    state.in[arcs[i].other].push_back({from, arcs[i].weight, link_id});
+                }
+            }
+        }
+    }
+
+    template <typename Weight>
+    void ContractionRouter<Weight>::AddArc(Contraction& state, VertexId from, VertexId to, Weight weight, Link link) {
+        auto& out = state.out[from];
+        const auto existing = std::find_if(out.begin(), out.end(), [to](const Arc& arc) { return arc.other == to; });
+        if (existing != out.end() && existing->weight <= weight) {
+            return;
+        }
+        const EdgeId link_id = links_.size();
+        links_.push_back(link);
+        if (existing != out.end()) {
+            *existing = {to, weight, link_id};
+            auto& in = state.in[to];
+            *std::find_if(in.begin(), in.end(), [from](const Arc& arc) { return arc.other == from; }) = {from, weight, link_id};
+        } else {
+            out.push_back({to, weight, link_id});
+            state.in[to].push_back({from, weight, link_id});
+        }
+    }
+
+    template <typename Weight>
+    int64_t ContractionRouter<Weight>::FindShortcuts(Contraction& state, VertexId vertex) const {
+        state.shortcuts.clear();
+        const auto& out = state.out[vertex];
+        for (const Arc& out_arc : out) {
+            state.targets[out_arc.other] = true;
+        }
+        for (const Arc& in_arc : state.in[vertex]) {
+            const VertexId source = in_arc.other;
+            // the witness search may stop past the heaviest candidate shortcut
+            Weight limit = -1;
+            for (const Arc& out_arc : out) {
+                if (out_arc.other != source) {
+                    limit = std::max(limit, in_arc.weight + out_arc.weight);
+                }
+            }
+            if (limit < 0) {
+                continue;
+            }
+
+            // witness search from the source around the contracted vertex,
+            // until all the targets are settled
+            size_t targets_left = out.size() - (state.targets[source] ? 1 : 0);
+            auto& weights = state.weights;
+            auto& queue = state.queue;
+            weights[source] = 0;
+            state.touched.push_back(source);
+            queue.emplace_back(0, source);
+            for (size_t settled = 0; !queue.empty() && settled != WITNESS_SETTLE_LIMIT;) {
+                std::pop_heap(queue.begin(), queue.end(), std::greater<>{});
+                const auto [weight, current] = queue.back();
+                queue.pop_back();
+                if (weight > weights[current]) {
+                    continue;
+                }
+                if (weight > limit) {
+                    break;
+                }
+                if (current != source && state.targets[current] && --targets_left == 0) {
+                    break;
+                }
+                ++settled;
+                for (const Arc& arc : state.out[current]) {
+                    if (arc.other == vertex) {
+                        continue;
+                    }
+                    const Weight candidate = weight + arc.weight;
+                    if (candidate < weights[arc.other]) {
+                        if (weights[arc.other] == INFINITE_WEIGHT) {
+                            state.touched.push_back(arc.other);
+                        }
+                        weights[arc.other] = candidate;
+                        queue.emplace_back(candidate, arc.other);
+                        std::push_heap(queue.begin(), queue.end(), std::greater<>{});
+                    }
+                }
+            }
+
+            for (const Arc& out_arc : out) {
+                const Weight weight = in_arc.weight + out_arc.weight;
+                if (out_arc.other != source && weights[out_arc.other] > weight) {
+                    state.shortcuts.push_back({source, out_arc.other, weight, in_arc.link, out_arc.link});
+                }
+            }
+            for (const VertexId touched : state.touched) {
+                weights[touched] = INFINITE_WEIGHT;
+            }
+            state.touched.clear();
+            queue.clear();
+        }
+        for (const Arc& out_arc : out) {
+            state.targets[out_arc.other] = false;
+        }
+        return static_cast<int64_t>(state.shortcuts.size()) - static_cast<int64_t>(out.size() + state.in[vertex].size())
+               + static_cast<int64_t>(state.contracted_neighbours[vertex] + state.depths[vertex]);
+    }
+
+    template <typename Weight>
+    void ContractionRouter<Weight>::ContractVertex(Contraction& state, VertexId vertex) {
+        // every remaining neighbour is contracted later, so ranks higher
+        state.up[vertex] = std::move(state.out[vertex]);
+        state.down[vertex] = std::move(state.in[vertex]);
+        const auto forget = [vertex](std::vector<Arc>& arcs) {
+            arcs.erase(std::remove_if(arcs.begin(), arcs.end(), [vertex](const Arc& arc) { return arc.other == vertex; }),
+                       arcs.end());
+        };
+        const auto lift = [&state, vertex](VertexId neighbour) {
+            ++state.contracted_neighbours[neighbour];
+            state.depths[neighbour] = std::max(state.depths[neighbour], state.depths[vertex] + 1);
+        };
+        for (const Arc& arc : state.up[vertex]) {
+            forget(state.in[arc.other]);
+            lift(arc.other);
+        }
+        for (const Arc& arc : state.down[vertex]) {
+            forget(state.out[arc.other]);
+            lift(arc.other);
+        }
+        state.out[vertex] = {};
+        state.in[vertex] = {};
+        for (const auto& shortcut : state.shortcuts) {
+            AddArc(state, shortcut.from, shortcut.to, shortcut.weight, {shortcut.first, shortcut.second});
+        }
+    }
+
+    template <typename Weight>
+    void ContractionRouter<Weight>::BuildSearchGraph(std::vector<std::vector<Arc>>& arcs,
+                                                      std::vector<EdgeId>& offsets, std::vector<Arc>& flat) {
+        offsets.assign(arcs.size() + 1, 0);
+        for (VertexId vertex = 0; vertex != arcs.size(); ++vertex) {
+            offsets[vertex + 1] = offsets[vertex] + arcs[vertex].size();
+        }
+        flat.clear();
+        flat.reserve(offsets.back());
+        for (auto& vertex_arcs : arcs) {
+            flat.insert(flat.end(), vertex_arcs.begin(), vertex_arcs.end());
+            vertex_arcs = {};
+        }
+    }
+
+    template <typename Weight>
+    std::span<const typename ContractionRouter<Weight>::Arc>
+    ContractionRouter<Weight>::GetArcs(size_t direction, VertexId vertex) const {
+        const auto& offsets = direction == 0 ? up_offsets_ : down_offsets_;
+        const auto& arcs = direction == 0 ? up_arcs_ : down_arcs_;
+        return {arcs.data() + offsets[vertex], arcs.data() + offsets[vertex + 1]};
+    }
+
+    template <typename Weight>
+    std::optional<Weight>
+    ContractionRouter<Weight>::FindRoute(VertexId from, VertexId to, std::vector<EdgeId>& edges) const {
+        edges.clear();
+        const size_t vertex_count = up_offsets_.size() - 1;
+        if (from >= vertex_count || to >= vertex_count) {
+            return std::nullopt;
+        }
+        auto space = AcquireSpace();
+        const auto reach = [&space](size_t direction, VertexId vertex, Weight weight, VertexId prev_vertex, EdgeId prev_link) {
+            auto& weights = space->weights[direction];
+            if (weights[vertex] == INFINITE_WEIGHT && space->weights[1 - direction][vertex] == INFINITE_WEIGHT) {
+                space->touched.push_back(vertex);
+            }
+            weights[vertex] = weight;
+            space->prev_vertices[direction][vertex] = prev_vertex;
+            space->prev_links[direction][vertex] = prev_link;
+            auto& queue = space->queues[direction];
+            queue.emplace_back(weight, vertex);
+            std::push_heap(queue.begin(), queue.end(), std::greater<>{});
+        };
+        reach(0, from, 0, NO_VERTEX, NO_EDGE);
+        reach(1, to, 0, NO_VERTEX, NO_EDGE);
+
+        // alternate by the lighter queue top; once both tops weigh at least
+        // the best route found, no route through an unsettled vertex is lighter
+        Weight best = INFINITE_WEIGHT;
+        VertexId meeting = NO_VERTEX;
+        while (true) {
+            const auto& forward = space->queues[0];
+            const auto& backward = space->queues[1];
+            const Weight forward_top = forward.empty() ? INFINITE_WEIGHT : forward.front().first;
+            const Weight backward_top = backward.empty() ? INFINITE_WEIGHT : backward.front().first;
+            if (std::min(forward_top, backward_top) >= best) {
+                break;
+            }
+            const size_t direction = forward_top <= backward_top ? 0 : 1;
+            auto& queue = space->queues[direction];
+            std::pop_heap(queue.begin(), queue.end(), std::greater<>{});
+            const auto [weight, vertex] = queue.back();
+            queue.pop_back();
+            if (weight > space->weights[direction][vertex]) {
+                continue;
+            }
+            if (const Weight other = space->weights[1 - direction][vertex]; weight + other < best) {
+                best = weight + other;
+                meeting = vertex;
+            }
+            for (const Arc& arc : GetArcs(direction, vertex)) {
+                const Weight candidate = weight + arc.weight;
+                if (candidate < space->weights[direction][arc.other]) {
+                    reach(direction, arc.other, candidate, vertex, arc.link);
+                }
+            }
+        }
+
+        std::optional<Weight> res;
+        if (meeting != NO_VERTEX) {
+            // hierarchy edges from the source up to the meeting vertex, then down to the target
+            auto& links = space->links;
+            for (VertexId vertex = meeting; vertex != from; vertex = space->prev_vertices[0][vertex]) {
+                links.push_back(space->prev_links[0][vertex]);
+            }
+            std::reverse(links.begin(), links.end());
+            for (VertexId vertex = meeting; vertex != to; vertex = space->prev_vertices[1][vertex]) {
+                links.push_back(space->prev_links[1][vertex]);
+            }
+            Unpack(links, edges);
+            res = best;
+        }
+
+        for (const VertexId vertex : space->touched) {
+            space->weights[0][vertex] = space->weights[1][vertex] = INFINITE_WEIGHT;
+        }
+        space->touched.clear();
+        space->queues[0].clear();
+        space->queues[1].clear();
+        space->links.clear();
+        ReleaseSpace(std::move(space));
+        return res;
+    }
+
+    template <typename Weight>
+    void ContractionRouter<Weight>::FindWeightMatrix(std::span<const VertexId> sources, std::span<const VertexId> targets,
+                                                     std::span<std::optional<Weight>> weights) const {
+        std::fill(weights.begin(), weights.end(), std::nullopt);
+        const std::span<const VertexId> ends[2] = {sources, targets};
+        std::vector<Reached> reached[2];
+        auto space = AcquireSpace();
+        for (size_t direction = 0; direction != 2; ++direction) {
+            for (size_t end = 0; end != ends[direction].size(); ++end) {
+                SearchUp(*space, direction, ends[direction][end], end, reached[direction]);
+            }
+            std::sort(reached[direction].begin(), reached[direction].end(), [](const Reached& lhs, const Reached& rhs) {
+                return lhs.vertex < rhs.vertex;
+            });
+        }
+        ReleaseSpace(std::move(space));
+
+        const auto other_vertex = [](VertexId vertex) {
+            return [vertex](const Reached& item) { return item.vertex != vertex; };
+        };
+        auto forward = reached[0].cbegin(), backward = reached[1].cbegin();
+        while (forward != reached[0].cend() && backward != reached[1].cend()) {
+            if (forward->vertex != backward->vertex) {
+                forward->vertex < backward->vertex ? ++forward : ++backward;
+                continue;
+            }
+            const auto forward_end = std::find_if(forward, reached[0].cend(), other_vertex(forward->vertex));
+            const auto backward_end = std::find_if(backward, reached[1].cend(), other_vertex(backward->vertex));
+            for (; forward != forward_end; ++forward) {
+                for (auto item = backward; item != backward_end; ++item) {
+                    auto& res = weights[forward->end * targets.size() + item->end];
+                    if (!res || forward->weight + item->weight < *res) {
+                        res = forward->weight + item->weight;
+                    }
+                }
+            }
+            backward = backward_end;
+        }
+    }
+
+    template <typename Weight>
+    void ContractionRouter<Weight>::SearchUp(SearchSpace& space, size_t direction, VertexId start, size_t end,
+                                             std::vector<Reached>& reached) const {
+        if (start >= up_offsets_.size() - 1) {
+            return;
+        }
+        auto& weights = space.weights[direction];
+        auto& queue = space.queues[direction];
+        weights[start] = 0;
+        space.touched.push_back(start);
+        queue.emplace_back(0, start);
+        while (!queue.empty()) {
+            std::pop_heap(queue.begin(), queue.end(), std::greater<>{});
+            const auto [weight, vertex] = queue.back();
+            queue.pop_back();
+            if (weight > weights[vertex]) {
+                continue;
+            }
+            reached.push_back({vertex, end, weight});
+            for (const Arc& arc : GetArcs(direction, vertex)) {
+                const Weight candidate = weight + arc.weight;
+                if (candidate < weights[arc.other]) {
+                    if (weights[arc.other] == INFINITE_WEIGHT) {
+                        space.touched.push_back(arc.other);
+                    }
+                    weights[arc.other] = candidate;
+                    queue.emplace_back(candidate, arc.other);
+                    std::push_heap(queue.begin(), queue.end(), std::greater<>{});
+                }
+            }
+        }
+        for (const VertexId vertex : space.touched) {
+            weights[vertex] = INFINITE_WEIGHT;
+        }
+        space.touched.clear();
+    }
+
+    template <typename Weight>
+    void ContractionRouter<Weight>::Unpack(std::vector<EdgeId>& links, std::vector<EdgeId>& edges) const {
+        // used as a stack, so the route goes on it back to front
+        std::reverse(links.begin(), links.end());
+        while (!links.empty()) {
+            const Link link = links_[links.back()];
+            links.pop_back();
+            if (link.second == NO_EDGE) {
+                edges.push_back(link.first);
+            } else {
+                links.push_back(link.second);
+                links.push_back(link.first);
+            }
+        }
+    }
+
+    template <typename Weight>
+    ContractionRouter<Weight>::SearchSpace::SearchSpace(size_t vertex_count)
+            : weights{std::vector<Weight>(vertex_count, INFINITE_WEIGHT), std::vector<Weight>(vertex_count, INFINITE_WEIGHT)},
+              prev_vertices{std::vector<VertexId>(vertex_count), std::vector<VertexId>(vertex_count)},
+              prev_links{std::vector<EdgeId>(vertex_count), std::vector<EdgeId>(vertex_count)}
+    {
+    }
+
+    template <typename Weight>
+    size_t ContractionRouter<Weight>::SearchSpace::GetMemoryUsage() const {
+        size_t res = touched.capacity() * sizeof(VertexId) + links.capacity() * sizeof(EdgeId);
+        for (size_t direction = 0; direction != 2; ++direction) {
+            res += weights[direction].capacity() * sizeof(Weight)
+                   + prev_vertices[direction].capacity() * sizeof(VertexId)
+                   + prev_links[direction].capacity() * sizeof(EdgeId)
+                   + queues[direction].capacity() * sizeof(QueueItem);
+        }
+        return res;
+    }
+
+    template <typename Weight>
+    std::unique_ptr<typename ContractionRouter<Weight>::SearchSpace>
+    ContractionRouter<Weight>::AcquireSpace() const {
+        {
+            std::lock_guard lock(spaces_mutex_);
+            if (!spaces_.empty()) {
+                auto res = std::move(spaces_.back());
+                spaces_.pop_back();
+                return res;
+            }
+        }
+        return std::make_unique<SearchSpace>(up_offsets_.size() - 1);
+    }
+
+    template <typename Weight>
+    void ContractionRouter<Weight>::ReleaseSpace(std::unique_ptr<SearchSpace> space) const {
+        std::lock_guard lock(spaces_mutex_);
+        spaces_.push_back(std::move(space));
+    }
+
+    template <typename Weight>
+    size_t ContractionRouter<Weight>::GetMemoryUsage() const {
+        size_t res = links_.capacity() * sizeof(Link)
+                     + (up_offsets_.capacity() + down_offsets_.capacity()) * sizeof(EdgeId)
+                     + (up_arcs_.capacity() + down_arcs_.capacity()) * sizeof(Arc);
+        std::lock_guard lock(spaces_mutex_);
+        for (const auto& space : spaces_) {
+            res += space->GetMemoryUsage();
+        }
+        return res;
+    }
+
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include "graph.h"
+#include "routing_engine.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+    // On-demand router: nothing is precomputed, a single-source Dijkstra is run
+    // the first time a route from some vertex is requested. The resulting
+    // shortest-path trees are kept in an LRU cache of at most cache_capacity
+    // sources, so memory is O(cache_capacity * V) instead of O(V^2).
+    //
+    // The cache is shared by all threads. Trees are computed outside of its
+    // lock and handed out by shared_ptr, so an eviction never invalidates a
+    // tree another thread is still walking.
+    //
+    // Update only drops the trees a graph change can affect: those using a
+    // removed edge and those an added edge would shorten.
+    template <typename Weight>
+    class DijkstraRouter : public RoutingEngine<Weight> {
+    private:
+        using Graph = DirectedWeightedGraph<Weight>;
+        using Base = RoutingEngine<Weight>;
+
+    public:
+        static constexpr size_t DEFAULT_CACHE_CAPACITY = 64;
+
+        explicit DijkstraRouter(const Graph& graph, size_t cache_capacity = DEFAULT_CACHE_CAPACITY);
+
+        using typename Base::RouteId;
+        using typename Base::RouteInfo;
+
+        std::optional<Weight> FindRoute(VertexId from, VertexId to, std::vector<EdgeId>& edges) const override;
+        // One tree per source answers all of its targets
+        void FindWeightMatrix(std::span<const VertexId> sources, std::span<const VertexId> targets,
+                              std::span<std::optional<Weight>> weights) const override;
+        void Update(std::span<const EdgeId> added, std::span<const EdgeId> removed) override;
+        size_t GetMemoryUsage() const override;
+
+        // Bytes for a full cache, plus one tree being computed
+        static size_t EstimateMemoryUsage(size_t vertex_count, size_t cache_capacity) {
+            return (cache_capacity + 1) * GetTreeSize(vertex_count);
+        }
+        static size_t GetTreeSize(size_t vertex_count) {
+            return vertex_count * (sizeof(std::optional<Weight>) + sizeof(EdgeId));
+        }
+
+    private:
+        static constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max();
+
+        struct ShortestPathTree {
+            std::vector<std::optional<Weight>> weights;
+            std::vector<EdgeId> prev_edges;
+        };
+
+        using TreePtr = std::shared_ptr<const ShortestPathTree>;
+        using CacheList = std::list<std::pair<VertexId, TreePtr>>;
+
+        const Graph& graph_;
+        size_t cache_capacity_;
+
+        mutable std::mutex trees_mutex_;
+        mutable CacheList trees_;
+        mutable std::unordered_map<VertexId, typename CacheList::iterator> trees_index_;
+
+        TreePtr GetTree(VertexId from) const;
+        ShortestPathTree ComputeTree(VertexId from) const;
+        bool IsAffected(const ShortestPathTree& tree, std::span<const EdgeId> added, std::span<const EdgeId> removed) const;
+    };
+
+
+    template <typename Weight>
+    DijkstraRouter<Weight>::DijkstraRouter(const Graph& graph, size_t cache_capacity)
+            : graph_(graph),
+              cache_capacity_(std::max<size_t>(cache_capacity, 1))
+    {
+    }
+
+    template <typename Weight>
+    std::optional<Weight>
+    DijkstraRouter<Weight>::FindRoute(VertexId from, VertexId to, std::vector<EdgeId>& edges) const {
+        edges.clear();
+        const TreePtr tree_ptr = GetTree(from);
+        const ShortestPathTree& tree = *tree_ptr;
+        // a tree may predate vertices added since, none of which it reaches
+        if (to >= tree.weights.size() || !tree.weights[to]) {
+            return std::nullopt;
+        }
+        for (EdgeId edge_id = tree.prev_edges[to]; edge_id != NO_EDGE;
+             edge_id = tree.prev_edges[graph_.GetEdge(edge_id).from]) {
+            edges.push_back(edge_id);
+        }
+        std::reverse(std::begin(edges), std::end(edges));
+        return tree.weights[to];
+    }
+
+    template <typename Weight>
+    void DijkstraRouter<Weight>::FindWeightMatrix(std::span<const VertexId> sources, std::span<const VertexId> targets,
+                                                  std::span<std::optional<Weight>> weights) const {
+        for (size_t i = 0; i != sources.size(); ++i) {
+            const TreePtr tree_ptr = GetTree(sources[i]);
+            const ShortestPathTree& tree = *tree_ptr;
+            for (size_t j = 0; j != targets.size(); ++j) {
+                weights[i * targets.size() + j] = targets[j] < tree.weights.size() ? tree.weights[targets[j]] : std::nullopt;
+            }
+        }
+    }
+
+    template <typename Weight>
+    size_t DijkstraRouter<Weight>::GetMemoryUsage() const {
+        std::lock_guard lock(trees_mutex_);
+        size_t res = 0;
+        for (const auto& [from, tree] : trees_) {
+            res += tree->weights.capacity() * sizeof(std::optional<Weight>) + tree->prev_edges.capacity() * sizeof(EdgeId);
+        }
+        return res;
+    }
+
+    template <typename Weight>
+    void DijkstraRouter<Weight>::Update(std::span<const EdgeId> added, std::span<const EdgeId> removed) {
+        std::lock_guard lock(trees_mutex_);
+        for (auto it = trees_.begin(); it != trees_.end();) {
+            if (IsAffected(*it->second, added, removed)) {
+                trees_index_.erase(it->first);
+                it = trees_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    template <typename Weight>
+    bool DijkstraRouter<Weight>::IsAffected(const ShortestPathTree& tree,
+                                            std::span<const EdgeId> added, std::span<const EdgeId> removed) const {
+        const size_t vertex_count = tree.weights.size();
+        for (const EdgeId edge_id : removed) {
+            const VertexId to = graph_.GetEdge(edge_id).to;
+            if (to < vertex_count && tree.prev_edges[to] == edge_id) {
+                return true;
+            }
+        }
+        // the tree is exact, so an edge that does not shorten the route to its
+        // own target does not shorten any other route either
+        for (const EdgeId edge_id : added) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            if (IsRemoved(edge) || edge.from >= vertex_count || !tree.weights[edge.from]) {
+                continue;
+            }
+            if (edge.to >= vertex_count || !tree.weights[edge.to]
+                || *tree.weights[edge.from] + edge.weight < *tree.weights[edge.to]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename Weight>
+    typename DijkstraRouter<Weight>::TreePtr
+    DijkstraRouter<Weight>::GetTree(VertexId from) const {
+        {
+            std::lock_guard lock(trees_mutex_);
+            if (auto it = trees_index_.find(from); it != trees_index_.end()) {
+                trees_.splice(trees_.begin(), trees_, it->second);
+                return it->second->second;
+            }
+        }
+        auto tree = std::make_shared<const ShortestPathTree>(ComputeTree(from));
+
+        std::lock_guard lock(trees_mutex_);
+        // another thread may have computed the same tree in the meantime
+        if (auto it = trees_index_.find(from); it != trees_index_.end()) {
+            trees_.splice(trees_.begin(), trees_, it->second);
+            return it->second->second;
+        }
+        if (trees_.size() >= cache_capacity_) {
+            trees_index_.erase(trees_.back().first);
+            trees_.pop_back();
+        }
+        trees_.emplace_front(from, std::move(tree));
+        trees_index_[from] = trees_.begin();
+        return trees_.front().second;
+    }
+
+    template <typename Weight>
+    typename DijkstraRouter<Weight>::ShortestPathTree
+    DijkstraRouter<Weight>::ComputeTree(VertexId from) const {
+        const size_t vertex_count = graph_.GetVertexCount();
+        ShortestPathTree tree{
+                std::vector<std::optional<Weight>>(vertex_count),
+                std::vector<EdgeId>(vertex_count, NO_EDGE)};
+
+        using QueueItem = std::pair<Weight, VertexId>;
+        std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<>> queue;
+
+        tree.weights[from] = Weight{0};
+        queue.emplace(Weight{0}, from);
+        while (!queue.empty()) {
+            const auto [weight, vertex] = queue.top();
+            queue.pop();
+            if (weight > *tree.weights[vertex]) {
+                continue;
+            }
+            for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+                const auto& edge = graph_.GetEdge(edge_id);
+                assert(edge.weight >= 0);
+                if (IsRemoved(edge)) {
+                    continue;
+                }
+                const Weight candidate_weight = weight + edge.weight;
+                auto& target_weight = tree.weights[edge.to];
+                if (!target_weight || candidate_weight < *target_weight) {
+                    target_weight = candidate_weight;
+                    tree.prev_edges[edge.to] = edge_id;
+                    queue.emplace(candidate_weight, edge.to);
+                }
+            }
+        }
+        return tree;
+    }
+
+}
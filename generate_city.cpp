@@ -0,0 +1,38 @@
+#include "city_generator.h"
+#include "json_writer.h"
+
+#include <exception>
+#include <iostream>
+#include <string_view>
+
+using namespace std;
+
+// Usage:
+//   generate_city [--<option> <value>]... [--pretty] > city.json
+// Options (see CityConfig): seed, stops, buses, min-route, max-route,
+// roundtrip-share, road-distance-share, queries, route-share, bus-share,
+// matrix-share, matrix-size, wait-time, velocity, router, graph-model,
+// landmarks, memory-budget-mb.
+int main(int argc, char *argv[]) {
+    CityConfig config;
+    auto style = Json::Writer::Style::Compact;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const string_view arg = argv[i];
+            if (arg == "--pretty") {
+                style = Json::Writer::Style::Pretty;
+            } else if (arg.substr(0, 2) != "--" || i + 1 == argc || !SetCityOption(config, arg.substr(2), argv[i + 1])) {
+                cerr << "Unknown option " << arg << '\n';
+                return 1;
+            } else {
+                ++i;
+            }
+        }
+        Json::Writer writer(cout, style);
+        WriteCity(config, writer);
+    } catch (const exception &e) {
+        cerr << "An error occured: " << e.what() << '\n';
+        return 1;
+    }
+    cout << '\n';
+}
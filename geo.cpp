@@ -0,0 +1,174 @@
+#include "geo.h"
+
+#include <cassert>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEO_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace Geo {
+
+    namespace {
+        // Coordinates::dist converts degrees with this value, kept for identical results
+        const double DEGREE = 3.1415926535 / 180;
+        const double HALF_PI = 1.5707963267948966;
+
+        // asin(s) = s * P(s^2) for s <= 0.5: the Taylor series of asin(s) / s,
+        // 24 terms, within 1 ulp on that range. Highest degree first.
+        constexpr double ASIN_COEFFICIENTS[] = {
+                0.0024894486782468836, 0.00265787063820729, 0.002846178401108942,
+                0.0030578216492580306, 0.003297059503473485, 0.0035692053938259347,
+                0.003880964558837669, 0.004240907093679363, 0.004660143486915096,
+                0.005153309682319905, 0.005740037670841924, 0.006447210311889649,
+                0.0073125258735988454, 0.008390335809616815, 0.009761609529194078,
+                0.011551800896139705, 0.01396484375, 0.017352764423076924,
+                0.022372159090909092, 0.030381944444444444, 0.044642857142857144,
+                0.075, 0.16666666666666666, 1.0};
+
+        // Larger arguments use asin(s) = pi/2 - 2 asin(sqrt((1 - s) / 2)).
+        double ChordToDistance(double chord_squared) {
+            const double s = min(sqrt(chord_squared) / 2, 1.0);
+            const bool reduced = s > 0.5;
+            const double u = reduced ? sqrt((1 - s) / 2) : s;
+            const double t = u * u;
+            double p = 0;
+            for (const double c : ASIN_COEFFICIENTS)
+                p = p * t + c;
+            const double asin_u = u * p;
+            const double asin_s = reduced ? HALF_PI - 2 * asin_u : asin_u;
+            return 2 * asin_s * EARTH_RADIUS;
+        }
+
+        double ChordSquared(double ax, double ay, double az, double bx, double by, double bz) {
+            const double dx = ax - bx, dy = ay - by, dz = az - bz;
+            return dx * dx + dy * dy + dz * dz;
+        }
+
+        void DistancesScalar(PointsView from, PointsView to, double *out, size_t begin, size_t end) {
+            for (size_t i = begin; i != end; ++i)
+                out[i] = ChordToDistance(ChordSquared(from.x[i], from.y[i], from.z[i], to.x[i], to.y[i], to.z[i]));
+        }
+
+#ifdef GEO_X86_KERNELS
+        __attribute__((target("avx2,fma"))) void DistancesAvx2(PointsView from, PointsView to, double *out, size_t count) {
+            const __m256d half = _mm256_set1_pd(0.5), one = _mm256_set1_pd(1.0);
+            const __m256d half_pi = _mm256_set1_pd(HALF_PI), two = _mm256_set1_pd(2.0);
+            const __m256d diameter = _mm256_set1_pd(2 * EARTH_RADIUS);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                const __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(from.x + i), _mm256_loadu_pd(to.x + i));
+                const __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(from.y + i), _mm256_loadu_pd(to.y + i));
+                const __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(from.z + i), _mm256_loadu_pd(to.z + i));
+                const __m256d chord_squared = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dz, dz)));
+                const __m256d s = _mm256_min_pd(_mm256_mul_pd(_mm256_sqrt_pd(chord_squared), half), one);
+                const __m256d reduced = _mm256_cmp_pd(s, half, _CMP_GT_OQ);
+                const __m256d u = _mm256_blendv_pd(s, _mm256_sqrt_pd(_mm256_mul_pd(_mm256_sub_pd(one, s), half)), reduced);
+                const __m256d t = _mm256_mul_pd(u, u);
+                __m256d p = _mm256_setzero_pd();
+                for (const double c : ASIN_COEFFICIENTS)
+                    p = _mm256_fmadd_pd(p, t, _mm256_set1_pd(c));
+                const __m256d asin_u = _mm256_mul_pd(u, p);
+                const __m256d asin_s = _mm256_blendv_pd(asin_u, _mm256_fnmadd_pd(two, asin_u, half_pi), reduced);
+                _mm256_storeu_pd(out + i, _mm256_mul_pd(asin_s, diameter));
+            }
+            DistancesScalar(from, to, out, i, count);
+        }
+
+        // SSE2 is part of x86-64; the attribute is for 32-bit x86, where HasSse2 is checked first
+        __attribute__((target("sse2"))) void DistancesSse2(PointsView from, PointsView to, double *out, size_t count) {
+            const __m128d half = _mm_set1_pd(0.5), one = _mm_set1_pd(1.0);
+            const __m128d half_pi = _mm_set1_pd(HALF_PI), two = _mm_set1_pd(2.0);
+            const __m128d diameter = _mm_set1_pd(2 * EARTH_RADIUS);
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2) {
+                const __m128d dx = _mm_sub_pd(_mm_loadu_pd(from.x + i), _mm_loadu_pd(to.x + i));
+                const __m128d dy = _mm_sub_pd(_mm_loadu_pd(from.y + i), _mm_loadu_pd(to.y + i));
+                const __m128d dz = _mm_sub_pd(_mm_loadu_pd(from.z + i), _mm_loadu_pd(to.z + i));
+                const __m128d chord_squared = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+                const __m128d s = _mm_min_pd(_mm_mul_pd(_mm_sqrt_pd(chord_squared), half), one);
+                const __m128d reduced = _mm_cmpgt_pd(s, half);
+                const __m128d reduced_u = _mm_sqrt_pd(_mm_mul_pd(_mm_sub_pd(one, s), half));
+                const __m128d u = _mm_or_pd(_mm_and_pd(reduced, reduced_u), _mm_andnot_pd(reduced, s));
+                const __m128d t = _mm_mul_pd(u, u);
+                __m128d p = _mm_setzero_pd();
+                for (const double c : ASIN_COEFFICIENTS)
+                    p = _mm_add_pd(_mm_mul_pd(p, t), _mm_set1_pd(c));
+                const __m128d asin_u = _mm_mul_pd(u, p);
+                const __m128d reduced_asin = _mm_sub_pd(half_pi, _mm_mul_pd(two, asin_u));
+                const __m128d asin_s = _mm_or_pd(_mm_and_pd(reduced, reduced_asin), _mm_andnot_pd(reduced, asin_u));
+                _mm_storeu_pd(out + i, _mm_mul_pd(asin_s, diameter));
+            }
+            DistancesScalar(from, to, out, i, count);
+        }
+
+        bool HasAvx2() {
+            static const bool res = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+            return res;
+        }
+        bool HasSse2() {
+            static const bool res = __builtin_cpu_supports("sse2");
+            return res;
+        }
+#endif
+    }// namespace
+
+    UnitVector ToUnitVector(Coordinates coords) {
+        const double lat = coords.lat_ * DEGREE, lon = coords.lon_ * DEGREE;
+        return {cos(lat) * cos(lon), cos(lat) * sin(lon), sin(lat)};
+    }
+
+    double Distance(const UnitVector &lhs, const UnitVector &rhs) {
+        return ChordToDistance(ChordSquared(lhs.x, lhs.y, lhs.z, rhs.x, rhs.y, rhs.z));
+    }
+
+    void Points::Reserve(size_t count) {
+        x_.reserve(count);
+        y_.reserve(count);
+        z_.reserve(count);
+    }
+
+    void Points::Add(UnitVector point) {
+        x_.push_back(point.x);
+        y_.push_back(point.y);
+        z_.push_back(point.z);
+    }
+
+    bool Distances(string_view kernel, PointsView from, PointsView to, span<double> out) {
+        assert(from.size == to.size && from.size == out.size());
+#ifdef GEO_X86_KERNELS
+        if (kernel == "avx2" && HasAvx2()) {
+            DistancesAvx2(from, to, out.data(), out.size());
+            return true;
+        }
+        if (kernel == "sse2" && HasSse2()) {
+            DistancesSse2(from, to, out.data(), out.size());
+            return true;
+        }
+#endif
+        if (kernel == "scalar") {
+            DistancesScalar(from, to, out.data(), 0, out.size());
+            return true;
+        }
+        return false;
+    }
+
+    string_view GetKernelName() {
+#ifdef GEO_X86_KERNELS
+        if (HasAvx2())
+            return "avx2";
+        if (HasSse2())
+            return "sse2";
+#endif
+        return "scalar";
+    }
+
+    void Distances(PointsView from, PointsView to, span<double> out) {
+        static const string_view kernel = GetKernelName();
+        Distances(kernel, from, to, out);
+    }
+
+}// namespace Geo
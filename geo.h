@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Coordinates.h"
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Great-circle distances between points cached as unit vectors, so that the
+// trigonometry is done once per point instead of once per pair.
+//
+// The angle between two points is found from the chord between their unit
+// vectors, theta = 2 asin(|a - b| / 2), with asin evaluated by a polynomial.
+// It only needs sqrt, multiplications and additions, so the batch kernel runs
+// on AVX2 (4 lanes, with FMA), on SSE2 (2 lanes) or on plain doubles. The
+// choice is made at runtime.
+//
+// Tolerance: the kernels agree with each other to KERNEL_TOLERANCE relative
+// (they only differ by FMA rounding) and with Coordinates::dist to 1 cm on
+// points 100 m apart or more. Most of the latter is the error of the acos
+// formula of Coordinates::dist, which loses precision for nearby points: it is
+// off by centimetres below a metre and gives NaN for some coincident ones.
+// geo_check verifies both.
+namespace Geo {
+
+    inline constexpr double EARTH_RADIUS = 6371000;// metres, as in Coordinates::dist
+    inline constexpr double KERNEL_TOLERANCE = 1e-12;
+
+    struct UnitVector {
+        double x, y, z;
+    };
+
+    UnitVector ToUnitVector(Coordinates coords);
+    // In metres
+    double Distance(const UnitVector &lhs, const UnitVector &rhs);
+
+    // Points stored one coordinate array at a time, the layout the kernels use
+    struct PointsView {
+        const double *x, *y, *z;
+        size_t size;
+
+        PointsView Subspan(size_t offset, size_t count) const {
+            return {x + offset, y + offset, z + offset, count};
+        }
+        UnitVector operator[](size_t i) const {
+            return {x[i], y[i], z[i]};
+        }
+    };
+
+    class Points {
+    public:
+        void Reserve(size_t count);
+        void Add(UnitVector point);
+        size_t Size() const { return x_.size(); }
+        UnitVector operator[](size_t i) const { return {x_[i], y_[i], z_[i]}; }
+        PointsView View() const { return {x_.data(), y_.data(), z_.data(), x_.size()}; }
+
+    private:
+        std::vector<double> x_, y_, z_;
+    };
+
+    // out[i] = Distance(from[i], to[i]); the three sizes must be equal
+    void Distances(PointsView from, PointsView to, std::span<double> out);
+    // Same with a given kernel: "avx2", "sse2" or "scalar". The result is
+    // false, and nothing is computed, if the CPU or build lacks that kernel.
+    bool Distances(std::string_view kernel, PointsView from, PointsView to, std::span<double> out);
+    // Name of the kernel Distances picks on this machine
+    std::string_view GetKernelName();
+
+}// namespace Geo
@@ -0,0 +1,78 @@
+#include "Coordinates.h"
+#include "checker.h"
+#include "geo.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    const size_t PAIR_COUNT = 4099;// not a multiple of any lane count
+
+    // Pairs within a city, which the acos formula of Coordinates::dist finds
+    // hardest, pairs anywhere on the globe, and coincident ones
+    vector<pair<Coordinates, Coordinates>> MakePairs() {
+        mt19937_64 random(1);
+        uniform_real_distribution<double> city_lat(55.55, 55.95), city_lon(37.35, 37.85);
+        uniform_real_distribution<double> lat(-89, 89), lon(-180, 180);
+        vector<pair<Coordinates, Coordinates>> res;
+        for (size_t i = 0; i != PAIR_COUNT; ++i) {
+            if (i % 3 == 0) {
+                res.push_back({{city_lat(random), city_lon(random)}, {city_lat(random), city_lon(random)}});
+            } else if (i % 3 == 1) {
+                res.push_back({{lat(random), lon(random)}, {lat(random), lon(random)}});
+            } else {
+                const Coordinates coords{city_lat(random), city_lon(random)};
+                res.push_back({coords, coords});
+            }
+        }
+        return res;
+    }
+
+    // Every batch kernel the machine has must agree with the scalar one to
+    // Geo::KERNEL_TOLERANCE, and the scalar one with Coordinates::dist to 1 cm
+    // on points 100 m apart or more
+    void CheckKernels(Checker &checker) {
+        const auto pairs = MakePairs();
+        Geo::Points from, to;
+        for (const auto &[lhs, rhs] : pairs) {
+            from.Add(Geo::ToUnitVector(lhs));
+            to.Add(Geo::ToUnitVector(rhs));
+        }
+        vector<double> expected(PAIR_COUNT), distances(PAIR_COUNT);
+        checker.Expect(Geo::Distances("scalar", from.View(), to.View(), expected), "no scalar distance kernel");
+        for (size_t i = 0; i != PAIR_COUNT; ++i) {
+            if (expected[i] < 100)// see geo.h
+                continue;
+            const double reference = Coordinates::dist(pairs[i].first, pairs[i].second);
+            checker.Expect(abs(expected[i] - reference) <= 0.01,
+                           "distance " + to_string(expected[i]) + " m, Coordinates::dist gives " + to_string(reference));
+        }
+        for (const string_view kernel : {"avx2", "sse2"}) {
+            if (!Geo::Distances(kernel, from.View(), to.View(), distances))
+                continue;
+            for (size_t i = 0; i != PAIR_COUNT; ++i) {
+                checker.Expect(abs(distances[i] - expected[i]) <= Geo::KERNEL_TOLERANCE * max(1.0, expected[i]),
+                               string(kernel) + " distance " + to_string(distances[i]) + " m, scalar gives "
+                                       + to_string(expected[i]));
+            }
+        }
+    }
+}// namespace
+
+// Usage:
+//   geo_check
+// Checks the distance kernels of geo.h that this machine has against each
+// other and against Coordinates::dist. Failed checks are printed on stderr,
+// and make the exit code 1.
+int main() {
+    Checker checker;
+    CheckKernels(checker);
+    return checker.Report();
+}
@@ -2,6 +2,8 @@
 
 #include <cstdlib>
 #include <deque>
+#include <iterator>
+#include <limits>
 #include <vector>
 
 template <typename It>
@@ -30,41 +32,153 @@ namespace Graph {
         Weight weight;
     };
 
+    // Removed edges keep their place, and so the ids of the other edges, with
+    // an infinite weight; routers never use them.
+    template <typename Weight>
+    bool IsRemoved(const Edge<Weight>& edge) {
+        return edge.weight == std::numeric_limits<Weight>::infinity();
+    }
+
+    // Iterates over the ids of the edges leaving a vertex: either through an
+    // incidence list or, for a frozen graph, over a contiguous range of ids.
+    class IncidentEdgeIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = EdgeId;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const EdgeId*;
+        using reference = EdgeId;
+
+        IncidentEdgeIterator(const EdgeId* ids, size_t pos) : ids_(ids), pos_(pos) {}
+
+        EdgeId operator*() const { return ids_ ? ids_[pos_] : pos_; }
+        IncidentEdgeIterator& operator++() { ++pos_; return *this; }
+        IncidentEdgeIterator operator++(int) { auto res = *this; ++pos_; return res; }
+        bool operator==(const IncidentEdgeIterator& other) const { return pos_ == other.pos_; }
+        bool operator!=(const IncidentEdgeIterator& other) const { return pos_ != other.pos_; }
+
+    private:
+        const EdgeId* ids_;
+        size_t pos_;
+    };
+
     template <typename Weight>
     class DirectedWeightedGraph {
     private:
         using IncidenceList = std::vector<EdgeId>;
-        using IncidentEdgesRange = Range<typename IncidenceList::const_iterator>;
+        using IncidentEdgesRange = Range<IncidentEdgeIterator>;
 
     public:
         DirectedWeightedGraph(size_t vertex_count);
+        VertexId AddVertex();
         EdgeId AddEdge(const Edge<Weight>& edge);
+        void RemoveEdge(EdgeId edge_id);
 
         size_t GetVertexCount() const;
         size_t GetEdgeCount() const;
         const Edge<Weight>& GetEdge(EdgeId edge_id) const;
         IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
+        // Heap bytes held by the graph
+        size_t GetMemoryUsage() const;
+
+        // Converts the graph to compressed sparse row form: edges are reordered
+        // by their source vertex, so the edges leaving a vertex are a contiguous
+        // run of the edge array and the incidence lists are replaced by a single
+        // offsets array. Edges keep their relative order within a vertex.
+        // Edge ids change; the returned vector maps old ids to new ones.
+        // AddEdge turns the graph back into the adjacency-list form.
+        std::vector<EdgeId> Freeze();
+        bool IsFrozen() const;
 
     private:
+        size_t vertex_count_;
         std::vector<Edge<Weight>> edges_;
         std::vector<IncidenceList> incidence_lists_;
+        std::vector<EdgeId> offsets_;// vertex_count_ + 1 entries once frozen
+
+        void Thaw();
     };
 
 
     template <typename Weight>
-    DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count) : incidence_lists_(vertex_count) {}
+    DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count)
+            : vertex_count_(vertex_count), incidence_lists_(vertex_count) {}
+
+    template <typename Weight>
+    VertexId DirectedWeightedGraph<Weight>::AddVertex() {
+        if (IsFrozen()) {
+            offsets_.push_back(offsets_.back());
+        } else {
+            incidence_lists_.emplace_back();
+        }
+        return vertex_count_++;
+    }
+
+    template <typename Weight>
+    void DirectedWeightedGraph<Weight>::RemoveEdge(EdgeId edge_id) {
+        edges_[edge_id].weight = std::numeric_limits<Weight>::infinity();
+    }
 
     template <typename Weight>
     EdgeId DirectedWeightedGraph<Weight>::AddEdge(const Edge<Weight>& edge) {
+        if (IsFrozen()) {
+            Thaw();
+        }
         edges_.push_back(edge);
         const EdgeId id = edges_.size() - 1;
         incidence_lists_[edge.from].push_back(id);
         return id;
     }
 
+    template <typename Weight>
+    std::vector<EdgeId> DirectedWeightedGraph<Weight>::Freeze() {
+        std::vector<EdgeId> new_ids(edges_.size());
+        if (IsFrozen()) {
+            for (EdgeId id = 0; id != edges_.size(); ++id) {
+                new_ids[id] = id;
+            }
+            return new_ids;
+        }
+
+        offsets_.assign(vertex_count_ + 1, 0);
+        for (const auto& edge : edges_) {
+            ++offsets_[edge.from + 1];
+        }
+        for (VertexId vertex = 0; vertex != vertex_count_; ++vertex) {
+            offsets_[vertex + 1] += offsets_[vertex];
+        }
+        std::vector<Edge<Weight>> sorted_edges(edges_.size());
+        for (VertexId vertex = 0; vertex != vertex_count_; ++vertex) {
+            EdgeId new_id = offsets_[vertex];
+            for (const EdgeId old_id : incidence_lists_[vertex]) {
+                sorted_edges[new_id] = edges_[old_id];
+                new_ids[old_id] = new_id++;
+            }
+        }
+        edges_ = std::move(sorted_edges);
+        incidence_lists_ = {};
+        return new_ids;
+    }
+
+    template <typename Weight>
+    bool DirectedWeightedGraph<Weight>::IsFrozen() const {
+        return !offsets_.empty();
+    }
+
+    template <typename Weight>
+    void DirectedWeightedGraph<Weight>::Thaw() {
+        incidence_lists_.assign(vertex_count_, {});
+        for (VertexId vertex = 0; vertex != vertex_count_; ++vertex) {
+            for (EdgeId id = offsets_[vertex]; id != offsets_[vertex + 1]; ++id) {
+                incidence_lists_[vertex].push_back(id);
+            }
+        }
+        offsets_ = {};
+    }
+
     template <typename Weight>
     size_t DirectedWeightedGraph<Weight>::GetVertexCount() const {
-        return incidence_lists_.size();
+        return vertex_count_;
     }
 
     template <typename Weight>
@@ -72,6 +186,16 @@ namespace Graph {
         return edges_.size();
     }
 
+    template <typename Weight>
+    size_t DirectedWeightedGraph<Weight>::GetMemoryUsage() const {
+        size_t res = edges_.capacity() * sizeof(Edge<Weight>) + offsets_.capacity() * sizeof(EdgeId)
+                     + incidence_lists_.capacity() * sizeof(IncidenceList);
+        for (const auto& list : incidence_lists_) {
+            res += list.capacity() * sizeof(EdgeId);
+        }
+        return res;
+    }
+
     template <typename Weight>
     const Edge<Weight>& DirectedWeightedGraph<Weight>::GetEdge(EdgeId edge_id) const {
         return edges_[edge_id];
@@ -80,7 +204,10 @@ namespace Graph {
     template <typename Weight>
     typename DirectedWeightedGraph<Weight>::IncidentEdgesRange
     DirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
+        if (IsFrozen()) {
+            return {{nullptr, offsets_[vertex]}, {nullptr, offsets_[vertex + 1]}};
+        }
         const auto& edges = incidence_lists_[vertex];
-        return {std::begin(edges), std::end(edges)};
+        return {{edges.data(), 0}, {edges.data(), edges.size()}};
     }
 }
\ No newline at end of file
@@ -0,0 +1,177 @@
+#include "json_arena.h"
+
+#include <algorithm>
+#include <variant>
+
+using namespace std;
+
+namespace Json {
+
+    bool ArenaNode::AsBool() const {
+        if (kind_ != Kind::Bool) {
+            throw bad_variant_access();
+        }
+        return bool_;
+    }
+
+    int ArenaNode::AsInt() const {
+        if (kind_ != Kind::Int) {
+            throw bad_variant_access();
+        }
+        return int_;
+    }
+
+    double ArenaNode::AsDouble() const {
+        if (kind_ == Kind::Int) {
+            return int_;
+        }
+        if (kind_ != Kind::Double) {
+            throw bad_variant_access();
+        }
+        return double_;
+    }
+
+    string_view ArenaNode::AsString() const {
+        if (kind_ != Kind::String) {
+            throw bad_variant_access();
+        }
+        return {string_, size_};
+    }
+
+    span<const ArenaNode> ArenaNode::AsArray() const {
+        if (kind_ != Kind::Array) {
+            throw bad_variant_access();
+        }
+        return {items_, size_};
+    }
+
+    span<const ArenaMember> ArenaNode::AsObject() const {
+        if (kind_ != Kind::Object) {
+            throw bad_variant_access();
+        }
+        return {members_, size_};
+    }
+
+    const ArenaNode *ArenaNode::Find(KeyId key) const {
+        for (const auto &member : AsObject()) {
+            if (member.key == key) {
+                return &member.value;
+            }
+        }
+        return nullptr;
+    }
+
+    const ArenaNode &ArenaNode::At(KeyId key) const {
+        if (const ArenaNode *res = Find(key)) {
+            return *res;
+        }
+        throw out_of_range("No such key in the JSON object");
+    }
+
+    ArenaDocument::ArenaDocument(string_view input) {
+        Load(input);
+    }
+
+    const ArenaNode &ArenaDocument::Load(string_view input) {
+        root_ = {};
+        arena_.release();
+        keys_.clear();
+        key_ids_.clear();
+        // left over from a document that failed to parse
+        item_stack_.clear();
+        member_stack_.clear();
+        Reader reader(input);
+        root_ = LoadNode(reader);
+        if (!reader.AtEnd()) {
+            throw ParseError("Unexpected input after the JSON value");
+        }
+        return root_;
+    }
+
+    const ArenaNode &ArenaDocument::GetRoot() const {
+        return root_;
+    }
+
+    KeyId ArenaDocument::FindKey(string_view key) const {
+        const auto it = key_ids_.find(key);
+        return it == key_ids_.end() ? NO_KEY : it->second;
+    }
+
+    string_view ArenaDocument::GetKey(KeyId key) const {
+        return keys_.at(key);
+    }
+
+    KeyId ArenaDocument::Intern(string_view key) {
+        if (const auto it = key_ids_.find(key); it != key_ids_.end()) {
+            return it->second;
+        }
+        const auto id = static_cast<KeyId>(keys_.size());
+        keys_.push_back(key);
+        key_ids_.emplace(key, id);
+        return id;
+    }
+
+    ArenaNode ArenaDocument::LoadNode(Reader &reader) {
+        ArenaNode node;
+        switch (reader.Peek()) {
+            case Reader::Kind::Array: {
+                const size_t stack_begin = item_stack_.size();
+                reader.BeginArray();
+                while (reader.NextElement()) {
+                    ArenaNode item = LoadNode(reader);
+                    item_stack_.push_back(item);
+                }
+                node.kind_ = ArenaNode::Kind::Array;
+                node.size_ = static_cast<uint32_t>(item_stack_.size() - stack_begin);
+                auto *items = static_cast<ArenaNode *>(arena_.allocate(node.size_ * sizeof(ArenaNode), alignof(ArenaNode)));
+                copy(item_stack_.begin() + stack_begin, item_stack_.end(), items);
+                item_stack_.resize(stack_begin);
+                node.items_ = items;
+                break;
+            }
+            case Reader::Kind::Object: {
+                const size_t stack_begin = member_stack_.size();
+                reader.BeginObject();
+                for (string_view key; reader.NextKey(key);) {
+                    const KeyId key_id = Intern(key);
+                    ArenaNode value = LoadNode(reader);
+                    member_stack_.push_back({key_id, value});
+                }
+                node.kind_ = ArenaNode::Kind::Object;
+                node.size_ = static_cast<uint32_t>(member_stack_.size() - stack_begin);
+                auto *members = static_cast<ArenaMember *>(arena_.allocate(node.size_ * sizeof(ArenaMember), alignof(ArenaMember)));
+                copy(member_stack_.begin() + stack_begin, member_stack_.end(), members);
+                member_stack_.resize(stack_begin);
+                node.members_ = members;
+                break;
+            }
+            case Reader::Kind::String: {
+                const string_view str = reader.ReadString();
+                node.kind_ = ArenaNode::Kind::String;
+                node.size_ = static_cast<uint32_t>(str.size());
+                node.string_ = str.data();
+                break;
+            }
+            case Reader::Kind::Number: {
+                const auto number = reader.ReadNumber();
+                if (holds_alternative<int>(number)) {
+                    node.kind_ = ArenaNode::Kind::Int;
+                    node.int_ = get<int>(number);
+                } else {
+                    node.kind_ = ArenaNode::Kind::Double;
+                    node.double_ = get<double>(number);
+                }
+                break;
+            }
+            case Reader::Kind::Bool:
+                node.kind_ = ArenaNode::Kind::Bool;
+                node.bool_ = reader.ReadBool();
+                break;
+            case Reader::Kind::Null:
+                reader.Skip();
+                break;
+        }
+        return node;
+    }
+
+}// namespace Json
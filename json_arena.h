@@ -0,0 +1,109 @@
+#pragma once
+
+#include "json_reader.h"
+
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Json {
+
+    using KeyId = uint32_t;
+    inline constexpr KeyId NO_KEY = UINT32_MAX;
+
+    struct ArenaMember;
+
+    // 16-byte DOM node. Arrays and objects point to contiguous runs of nodes or
+    // members in the document's arena; strings point into the source buffer.
+    // Accessing a node as the wrong kind throws std::bad_variant_access, like
+    // Json::Node does.
+    class ArenaNode {
+    public:
+        enum class Kind : uint8_t {
+            Null,
+            Bool,
+            Int,
+            Double,
+            String,
+            Array,
+            Object
+        };
+
+        Kind GetKind() const { return kind_; }
+
+        bool AsBool() const;
+        int AsInt() const;
+        double AsDouble() const;// accepts Int nodes too
+        std::string_view AsString() const;
+        std::span<const ArenaNode> AsArray() const;
+        std::span<const ArenaMember> AsObject() const;
+
+        // Linear scan over the members comparing interned key ids; objects in
+        // requests have a handful of members, so this beats any tree or hash.
+        const ArenaNode *Find(KeyId key) const;
+        const ArenaNode &At(KeyId key) const;
+
+    private:
+        friend class ArenaDocument;
+
+        Kind kind_ = Kind::Null;
+        uint32_t size_ = 0;
+        union {
+            bool bool_;
+            int int_;
+            double double_ = 0;
+            const char *string_;
+            const ArenaNode *items_;
+            const ArenaMember *members_;
+        };
+    };
+
+    struct ArenaMember {
+        KeyId key;
+        ArenaNode value;
+    };
+
+    // Alternative to Json::Document: all nodes of a document live in a single
+    // monotonic arena, so destroying or reloading a document of any size is one
+    // release. Object keys are interned into ids for the loaded document; like
+    // the nodes, ids and keys are only valid until the next Load(), and the
+    // source buffer must outlive them.
+    class ArenaDocument {
+    public:
+        ArenaDocument() = default;
+        explicit ArenaDocument(std::string_view input);
+
+        ArenaDocument(const ArenaDocument &) = delete;
+        ArenaDocument &operator=(const ArenaDocument &) = delete;
+
+        // Drops the previous document and its keys, keeping the arena's memory
+        // for reuse. `input` must hold a single value, with nothing but
+        // whitespace after it.
+        const ArenaNode &Load(std::string_view input);
+        const ArenaNode &GetRoot() const;
+
+        // NO_KEY if no object of the loaded document has this key.
+        KeyId FindKey(std::string_view key) const;
+        std::string_view GetKey(KeyId key) const;
+
+    private:
+        std::pmr::unsynchronized_pool_resource upstream_;
+        std::pmr::monotonic_buffer_resource arena_{&upstream_};
+        ArenaNode root_;
+
+        // views into the source buffer
+        std::vector<std::string_view> keys_;
+        std::unordered_map<std::string_view, KeyId> key_ids_;
+
+        // scratch stacks for the children of the containers being parsed
+        std::vector<ArenaNode> item_stack_;
+        std::vector<ArenaMember> member_stack_;
+
+        KeyId Intern(std::string_view key);
+        ArenaNode LoadNode(Reader &reader);
+    };
+
+}// namespace Json
@@ -0,0 +1,202 @@
+#include "json_reader.h"
+
+#include <charconv>
+#include <cstring>
+
+using namespace std;
+
+namespace Json {
+
+    void Reader::Fail(const string &what) const {
+        throw ParseError(what + " at offset " + to_string(pos_));
+    }
+
+    void Reader::SkipWhitespace() {
+        while (pos_ < input_.size() && (input_[pos_] == ' ' || input_[pos_] == '\n' ||
+                                        input_[pos_] == '\r' || input_[pos_] == '\t')) {
+            ++pos_;
+        }
+    }
+
+    char Reader::Next() {
+        SkipWhitespace();
+        if (pos_ == input_.size()) {
+            Fail("Unexpected end of input");
+        }
+        return input_[pos_];
+    }
+
+    void Reader::Expect(char c) {
+        if (Next() != c) {
+            Fail(string("Expected '") + c + "'");
+        }
+        ++pos_;
+    }
+
+    bool Reader::AtEnd() {
+        SkipWhitespace();
+        return pos_ == input_.size();
+    }
+
+    Reader::Kind Reader::Peek() {
+        switch (Next()) {
+            case '{':
+                return Kind::Object;
+            case '[':
+                return Kind::Array;
+            case '"':
+                return Kind::String;
+            case 't':
+            case 'f':
+                return Kind::Bool;
+            case 'n':
+                return Kind::Null;
+            default:
+                return Kind::Number;
+        }
+    }
+
+    void Reader::BeginObject() {
+        Expect('{');
+        first_ = true;
+    }
+
+    bool Reader::NextKey(string_view &key) {
+        if (Next() == '}') {
+            ++pos_;
+            first_ = false;
+            return false;
+        }
+        if (!first_) {
+            Expect(',');
+        }
+        first_ = false;
+        key = ReadString();
+        Expect(':');
+        return true;
+    }
+
+    void Reader::BeginArray() {
+        Expect('[');
+        first_ = true;
+    }
+
+    bool Reader::NextElement() {
+        if (Next() == ']') {
+            ++pos_;
+            first_ = false;
+            return false;
+        }
+        if (!first_) {
+            Expect(',');
+        }
+        first_ = false;
+        return true;
+    }
+
+    string_view Reader::ReadString() {
+        Expect('"');
+        const size_t begin = pos_;
+        while (pos_ < input_.size() && input_[pos_] != '"') {
+            pos_ += input_[pos_] == '\\' ? 2 : 1;
+        }
+        if (pos_ >= input_.size()) {
+            Fail("Unterminated string");
+        }
+        return input_.substr(begin, pos_++ - begin);
+    }
+
+    string_view Reader::ReadNumberToken() {
+        Next();
+        const size_t begin = pos_;
+        while (pos_ < input_.size() && strchr("+-0123456789.eE", input_[pos_]) && input_[pos_] != '\0') {
+            ++pos_;
+        }
+        if (begin == pos_) {
+            Fail("Expected a number");
+        }
+        return input_.substr(begin, pos_ - begin);
+    }
+
+    int Reader::ReadInt() {
+        const string_view token = ReadNumberToken();
+        int result = 0;
+        const auto [end, error] = from_chars(token.data(), token.data() + token.size(), result);
+        if (error != errc{} || end != token.data() + token.size()) {
+            Fail("Expected an integer");
+        }
+        return result;
+    }
+
+    double Reader::ReadDouble() {
+        string_view token = ReadNumberToken();
+        // from_chars does not accept a leading plus
+        if (token.front() == '+') {
+            token.remove_prefix(1);
+        }
+        double result = 0;
+        const auto [end, error] = from_chars(token.data(), token.data() + token.size(), result);
+        if (error != errc{} || end != token.data() + token.size()) {
+            Fail("Expected a number");
+        }
+        return result;
+    }
+
+    variant<int, double> Reader::ReadNumber() {
+        const size_t begin = (Next(), pos_);
+        const string_view token = ReadNumberToken();
+        if (token.find_first_of(".eE") == string_view::npos) {
+            pos_ = begin;
+            return ReadInt();
+        }
+        pos_ = begin;
+        return ReadDouble();
+    }
+
+    bool Reader::ReadBool() {
+        Next();
+        if (input_.substr(pos_, 4) == "true") {
+            pos_ += 4;
+            return true;
+        }
+        if (input_.substr(pos_, 5) == "false") {
+            pos_ += 5;
+            return false;
+        }
+        Fail("Expected a bool");
+    }
+
+    void Reader::Skip() {
+        switch (Peek()) {
+            case Kind::Object: {
+                BeginObject();
+                for (string_view key; NextKey(key);) {
+                    Skip();
+                }
+                break;
+            }
+            case Kind::Array:
+                BeginArray();
+                while (NextElement()) {
+                    Skip();
+                }
+                break;
+            case Kind::String:
+                ReadString();
+                break;
+            case Kind::Bool:
+                ReadBool();
+                break;
+            case Kind::Null:
+                if (input_.substr(pos_, 4) != "null") {
+                    Fail("Expected null");
+                }
+                pos_ += 4;
+                break;
+            case Kind::Number:
+                ReadNumberToken();
+                break;
+        }
+    }
+
+}// namespace Json
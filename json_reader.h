@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+
+namespace Json {
+
+    struct ParseError : std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    // Pull parser over an in-memory (typically memory-mapped) document.
+    // Nothing is copied: strings and keys are returned as views into the
+    // buffer, which must outlive everything read from it. Escape sequences
+    // are left as they are, like in Json::Load.
+    //
+    //     reader.BeginObject();
+    //     for (std::string_view key; reader.NextKey(key);) {
+    //         if (key == "name") name = reader.ReadString();
+    //         else reader.Skip();
+    //     }
+    class Reader {
+    public:
+        enum class Kind {
+            Object,
+            Array,
+            String,
+            Number,
+            Bool,
+            Null
+        };
+
+        explicit Reader(std::string_view input) : input_(input) {}
+
+        Kind Peek();
+
+        void BeginObject();
+        // Reads the next key of the current object; false once it is over.
+        bool NextKey(std::string_view &key);
+
+        void BeginArray();
+        // Moves to the next element of the current array; false once it is over.
+        bool NextElement();
+
+        std::string_view ReadString();
+        int ReadInt();
+        double ReadDouble();// accepts integers too
+        // int unless the number has a fraction or an exponent, as in Json::Load
+        std::variant<int, double> ReadNumber();
+        bool ReadBool();
+        void Skip();
+
+        bool AtEnd();
+
+    private:
+        std::string_view input_;
+        size_t pos_ = 0;
+        // whether the current object or array has yielded an element yet
+        bool first_ = false;
+
+        void SkipWhitespace();
+        char Next();
+        void Expect(char c);
+        std::string_view ReadNumberToken();
+        [[noreturn]] void Fail(const std::string &what) const;
+    };
+
+}// namespace Json
@@ -0,0 +1,156 @@
+#include "json_writer.h"
+
+#include <charconv>
+#include <cmath>
+
+using namespace std;
+
+namespace Json {
+
+    Writer::Writer(ostream &output, Style style, size_t flush_threshold)
+        : output_(output), style_(style), flush_threshold_(flush_threshold) {
+        buffer_.reserve(flush_threshold_ + 256);
+    }
+
+    Writer::~Writer() {
+        try {
+            Flush();
+        } catch (...) {
+        }
+    }
+
+    void Writer::Flush() {
+        output_.write(buffer_.data(), static_cast<streamsize>(buffer_.size()));
+        buffer_.clear();
+    }
+
+    void Writer::MaybeFlush() {
+        if (buffer_.size() >= flush_threshold_) {
+            Flush();
+        }
+    }
+
+    void Writer::NewLine() {
+        if (style_ == Style::Pretty) {
+            buffer_ += '\n';
+            buffer_.append(4 * empty_.size(), ' ');
+        }
+    }
+
+    void Writer::BeginValue() {
+        if (after_key_) {
+            after_key_ = false;
+            return;
+        }
+        if (!empty_.empty()) {
+            if (!empty_.back()) {
+                buffer_ += ',';
+            }
+            empty_.back() = false;
+            NewLine();
+        }
+    }
+
+    void Writer::Open(char bracket) {
+        BeginValue();
+        buffer_ += bracket;
+        empty_.push_back(true);
+    }
+
+    void Writer::Close(char bracket) {
+        const bool was_empty = empty_.back();
+        empty_.pop_back();
+        if (!was_empty) {
+            NewLine();
+        }
+        buffer_ += bracket;
+        MaybeFlush();
+    }
+
+    Writer &Writer::BeginObject() {
+        Open('{');
+        return *this;
+    }
+
+    Writer &Writer::EndObject() {
+        Close('}');
+        return *this;
+    }
+
+    Writer &Writer::BeginArray() {
+        Open('[');
+        return *this;
+    }
+
+    Writer &Writer::EndArray() {
+        Close(']');
+        return *this;
+    }
+
+    Writer &Writer::Key(string_view key) {
+        String(key);
+        buffer_ += style_ == Style::Pretty ? ": " : ":";
+        after_key_ = true;
+        return *this;
+    }
+
+    Writer &Writer::String(string_view str) {
+        BeginValue();
+        buffer_ += '"';
+        buffer_ += str;
+        buffer_ += '"';
+        return *this;
+    }
+
+    Writer &Writer::Text(string_view text) {
+        static constexpr char HEX[] = "0123456789abcdef";
+        BeginValue();
+        buffer_ += '"';
+        for (const char c : text) {
+            if (c == '"' || c == '\\') {
+                buffer_ += '\\';
+                buffer_ += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                buffer_ += "\\u00";
+                buffer_ += HEX[c >> 4];
+                buffer_ += HEX[c & 0xf];
+            } else {
+                buffer_ += c;
+            }
+        }
+        buffer_ += '"';
+        return *this;
+    }
+
+    Writer &Writer::Int(int64_t value) {
+        BeginValue();
+        char chars[24];
+        const auto res = to_chars(begin(chars), end(chars), value);
+        buffer_.append(chars, res.ptr);
+        return *this;
+    }
+
+    Writer &Writer::Double(double value) {
+        if (!isfinite(value)) {
+            return Null();
+        }
+        BeginValue();
+        char chars[32];
+        const auto res = to_chars(begin(chars), end(chars), value);
+        buffer_.append(chars, res.ptr);
+        return *this;
+    }
+
+    Writer &Writer::Bool(bool value) {
+        BeginValue();
+        buffer_ += value ? "true" : "false";
+        return *this;
+    }
+
+    Writer &Writer::Null() {
+        BeginValue();
+        buffer_ += "null";
+        return *this;
+    }
+
+}// namespace Json
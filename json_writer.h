@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Json {
+
+    // Streaming JSON serializer. Output is appended to an internal buffer that
+    // is written to the stream in large chunks, so no per-value stream calls or
+    // allocations are made once the buffer has grown. Commas and (in pretty
+    // mode) newlines and indentation are inserted automatically.
+    //
+    //     writer.BeginObject();
+    //     writer.Key("request_id").Int(1);
+    //     writer.Key("buses").BeginArray().String("297").EndArray();
+    //     writer.EndObject();
+    class Writer {
+    public:
+        enum class Style {
+            Pretty, // one value per line, indented by four spaces
+            Compact // no whitespace at all
+        };
+
+        static constexpr size_t DEFAULT_FLUSH_THRESHOLD = 1 << 16;
+
+        explicit Writer(std::ostream &output, Style style = Style::Pretty,
+                        size_t flush_threshold = DEFAULT_FLUSH_THRESHOLD);
+        // Flushes whatever is left in the buffer.
+        ~Writer();
+
+        Writer(const Writer &) = delete;
+        Writer &operator=(const Writer &) = delete;
+
+        Writer &BeginObject();
+        Writer &EndObject();
+        Writer &BeginArray();
+        Writer &EndArray();
+        Writer &Key(std::string_view key);
+
+        // Writes `str` between quotes as it is. Names come from the input with
+        // their escape sequences intact (see Json::Reader), so they are
+        // already valid JSON string contents.
+        Writer &String(std::string_view str);
+        // Escapes quotes, backslashes and control characters of `text`.
+        Writer &Text(std::string_view text);
+        Writer &Int(int64_t value);
+        // Shortest representation that reads back to the same double;
+        // infinities and NaN become null.
+        Writer &Double(double value);
+        Writer &Bool(bool value);
+        Writer &Null();
+
+        // Writes the buffer to the stream (without flushing the stream itself).
+        void Flush();
+
+    private:
+        std::ostream &output_;
+        Style style_;
+        size_t flush_threshold_;
+        std::string buffer_;
+        // for every open object or array, whether it has no elements yet
+        std::vector<bool> empty_;
+        bool after_key_ = false;
+
+        void BeginValue();
+        void Open(char bracket);
+        void Close(char bracket);
+        void NewLine();
+        void MaybeFlush();
+    };
+
+}// namespace Json
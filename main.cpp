@@ -1,59 +1,330 @@
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
 #include <fstream>
-#include <iomanip>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <regex>
+#include <span>
 
 
+#include "catalog_publisher.h"
+#include "json_arena.h"
+#include "json_reader.h"
+#include "json_writer.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "requests.h"
 #include "route_manager.h"
 
 
 using namespace std;
 
 #include <istream>
-#include <map>
 #include <string>
-#include <variant>
+#include <string_view>
 #include <vector>
 
-void serve_requests(istream &input = cin, ostream &output = cout) {
-    const Json::Document input_doc = Json::Load(input);
-    RouteManager mg(
-            input_doc.GetRoot().AsMap().at("routing_settings").AsMap().at("bus_wait_time").AsInt(),
-            input_doc.GetRoot().AsMap().at("routing_settings").AsMap().at("bus_velocity").AsInt());
-    const auto &update_requests = input_doc.GetRoot().AsMap().at("base_requests").AsArray();
-    for (const auto &update_request : update_requests) {
-        mg.MakeUpdate(update_request.AsMap());
+RoutingSettings read_routing_settings(Json::Reader &reader) {
+    RoutingSettings res{0, 0};
+    // optional: "router": "all_pairs" | "on_demand" | "contraction" | "a_star",
+    //           "router_cache_size": <int>, "router_landmarks": <int>,
+    //           "router_block_size": <int>, "router_threads": <int>,
+    //           "graph_model": "stop_pairs" | "linear", "memory_budget_mb": <int>
+    reader.BeginObject();
+    for (string_view key; reader.NextKey(key);) {
+        if (key == "bus_wait_time")
+            res.wait_time = reader.ReadInt();
+        else if (key == "bus_velocity")
+            res.velocity = reader.ReadInt() * 16.66;
+        else if (key == "router") {
+            const auto router = reader.ReadString();
+            if (router == "on_demand")
+                res.router_mode = RouterMode::OnDemand;
+            else if (router == "contraction")
+                res.router_mode = RouterMode::Contraction;
+            else if (router == "a_star")
+                res.router_mode = RouterMode::AStar;
+            else
+                res.router_mode = RouterMode::AllPairs;
+        }
+        else if (key == "router_cache_size")
+            res.router_cache_size = reader.ReadInt();
+        else if (key == "router_landmarks")
+            res.a_star.landmark_count = reader.ReadInt();
+        else if (key == "graph_model")
+            res.graph_model = reader.ReadString() == "linear" ? GraphModel::Linear : GraphModel::StopPairs;
+        else if (key == "router_block_size")
+            res.all_pairs.block_size = reader.ReadInt();
+        else if (key == "router_threads")
+            res.all_pairs.thread_count = reader.ReadInt();
+        else if (key == "memory_budget_mb")
+            res.memory_budget = static_cast<size_t>(reader.ReadInt()) << 20;
+        else
+            reader.Skip();
     }
+    return res;
+}
+
+// Parse time is taken per request, so that it leaves out MakeUpdate
+template<typename Read>
+auto timed_parse(Read read) {
+    const Metrics::Span timing(Metrics::Phase::Parse);
+    return read();
+}
+
+// Streams through the input document. Settings and base requests go straight
+// into `mg` (they are skipped when it is null); stat requests are collected and
+// returned, since they may only be answered once the whole base is known and
+// `mg` has been finalized.
+vector<Requests::StatRequest> read_document(Json::Reader &reader, RouteManager *mg) {
+    vector<Requests::StatRequest> stat_requests;
+    reader.BeginObject();
+    for (string_view key; reader.NextKey(key);) {
+        if (key == "routing_settings" && mg) {
+            mg->SetRoutingSettings(read_routing_settings(reader));
+        } else if (key == "base_requests" && mg) {
+            reader.BeginArray();
+            while (reader.NextElement()) {
+                mg->MakeUpdate(timed_parse([&reader] { return Requests::ReadUpdate(reader); }));
+            }
+        } else if (key == "stat_requests") {
+            reader.BeginArray();
+            while (reader.NextElement()) {
+                stat_requests.push_back(timed_parse([&reader] { return Requests::ReadStatRequest(reader); }));
+            }
+        } else {
+            reader.Skip();
+        }
+    }
+    if (mg)
+        mg->Finalize();
+    return stat_requests;
+}
+
+// The estimate is the input alone, known before parsing; stat requests add to it
+void record_document_memory(string_view text, const vector<Requests::StatRequest> &stat_requests) {
+    Metrics::SetMemoryEstimate(Metrics::Memory::JsonDocument, text.size());
+    Metrics::SetMemoryUsage(Metrics::Memory::JsonDocument,
+                            text.size() + stat_requests.capacity() * sizeof(Requests::StatRequest));
+}
+
+// Requests are answered on a thread pool in windows of this size; each window
+// is written out in input order before the next one starts.
+const size_t STAT_REQUESTS_WINDOW = 1 << 14;
+
+void serve_stat_requests(const RouteManager &mg, const vector<Requests::StatRequest> &stats_requests, ostream &output,
+                         Json::Writer::Style style) {
+    ThreadPool pool(ThreadPool::DefaultThreadCount());
+    Json::Writer writer(output, style);
+    writer.BeginArray();
+    for (size_t begin = 0; begin < stats_requests.size(); begin += STAT_REQUESTS_WINDOW) {
+        const size_t end = min(stats_requests.size(), begin + STAT_REQUESTS_WINDOW);
+        const auto responses = mg.MakeCalls(span(stats_requests).subspan(begin, end - begin), pool);
+        const Metrics::Span serialize(Metrics::Phase::Serialize);
+        for (const auto &response : responses)
+            response->Write(writer);
+    }
+    writer.EndArray();
+}
+
+string read_all(istream &input) {
+    return {istreambuf_iterator<char>(input), istreambuf_iterator<char>()};
+}
+
+void serve_requests(string_view input, ostream &output = cout, Json::Writer::Style style = Json::Writer::Style::Pretty) {
+    Json::Reader reader(input);
+    RouteManager mg;
+    const auto stat_requests = read_document(reader, &mg);
+    record_document_memory(input, stat_requests);
+    serve_stat_requests(mg, stat_requests, output, style);
+}
+
+// Phase one: builds the base and the routes and stores them in a snapshot.
+void make_base(istream &input, const string &snapshot_path) {
+    const string text = read_all(input);
+    Json::Reader reader(text);
+    RouteManager mg;
+    record_document_memory(text, read_document(reader, &mg));
+    mg.SaveSnapshot(snapshot_path);
+}
 
-    const auto &stats_requests = input_doc.GetRoot().AsMap().at("stat_requests").AsArray();
+// Phase two: answers stat_requests from a snapshot, nothing is rebuilt.
+void process_requests(const string &snapshot_path, Json::Writer::Style style, istream &input = cin, ostream &output = cout) {
+    const auto mg = RouteManager::LoadSnapshot(snapshot_path);
+    const string text = read_all(input);
+    Json::Reader reader(text);
+    const auto stat_requests = read_document(reader, nullptr);
+    record_document_memory(text, stat_requests);
+    serve_stat_requests(*mg, stat_requests, output, style);
+}
 
-    output << "[\n";
-    for (int i = 0; i != stats_requests.size(); ++i) {
-        auto elem = stats_requests[i].AsMap();
-        auto res = mg.MakeCall(elem);
-        res->operator<<(output);
-        if (i != stats_requests.size() - 1)
-            output << ", \n";
+// Loads a base either from a snapshot or from a JSON document with
+// routing_settings and base_requests (its stat_requests are ignored).
+unique_ptr<RouteManager> load_base(const string &path) {
+    {
+        const MappedFile file(path);
+        if (!Snapshot::LooksLikeSnapshot(file.GetData())) {
+            auto mg = make_unique<RouteManager>();
+            Json::Reader reader(file.GetText());
+            record_document_memory(file.GetText(), read_document(reader, mg.get()));
+            return mg;
+        }
     }
-    output << "\n]";
+    return RouteManager::LoadSnapshot(path);
+}
+
+bool is_request_of_type(const Json::ArenaDocument &doc, const Json::ArenaNode &request, string_view request_type) {
+    if (request.GetKind() != Json::ArenaNode::Kind::Object)
+        return false;
+    const auto *type = request.Find(doc.FindKey("type"));
+    return type && type->GetKind() == Json::ArenaNode::Kind::String && type->AsString() == request_type;
+}
+
+// Waits for the snapshots being built; a build that failed is reported on
+// stderr, the previous snapshot stays in use
+void finish_publishing(vector<future<shared_ptr<const RouteManager>>> &publishing, bool wait) {
+    erase_if(publishing, [wait](auto &build) {
+        if (!wait && build.wait_for(chrono::seconds(0)) != future_status::ready)
+            return false;
+        try {
+            build.get();
+        } catch (const exception &e) {
+            cerr << "Publishing failed: " << e.what() << '\n';
+        }
+        return true;
+    });
 }
-// 5 -> 4
 
-int main() {
-    ifstream file;
-    file.open(R"(C:\Users\mikes\CLionProjects\route_manager\tests.json)");
-    if (!file) {
-        cout << "Unable to open file";
-        exit(1);// terminate with error
+// Long-lived query worker: the base is loaded once, then requests arrive on
+// `input` as one JSON object per line. Every response is written and flushed
+// as soon as it is ready, on a line of its own; a malformed line gets an
+// error object, and {"type": "Stats"} the stats document of metrics.h.
+//
+// The base may change meanwhile: {"base_requests": [...]} queues updates,
+// answered with {"pending_updates": <count>}, and {"type": "Publish"} builds
+// a snapshot with them in the background, answered with {"publishing":
+// <count>} right away. Stat requests are served from the previous snapshot
+// until the new one is swapped in.
+void serve_stream(const string &base_path, istream &input = cin, ostream &output = cout) {
+    CatalogPublisher publisher(load_base(base_path));
+    vector<future<shared_ptr<const RouteManager>>> publishing;
+    Json::ArenaDocument doc;
+    Json::Writer writer(output, Json::Writer::Style::Compact);
+    for (string line; getline(input, line);) {
+        if (line.find_first_not_of(" \t\r") == string::npos)
+            continue;
+        // the snapshot a response comes from is kept until it is written
+        shared_ptr<const RouteManager> snapshot;
+        unique_ptr<Response> response;
+        try {
+            const auto &request = doc.Load(line);
+            const auto *updates = request.GetKind() == Json::ArenaNode::Kind::Object
+                                          ? request.Find(doc.FindKey("base_requests"))
+                                          : nullptr;
+            if (is_request_of_type(doc, request, "Stats")) {
+                Metrics::Write(writer);
+            } else if (updates) {
+                for (const auto &update : updates->AsArray())
+                    publisher.MakeUpdate(timed_parse([&] { return Requests::ParseUpdate(doc, update); }));
+                writer.BeginObject().Key("pending_updates").Int(static_cast<int64_t>(publisher.GetPendingUpdateCount())).EndObject();
+            } else if (is_request_of_type(doc, request, "Publish")) {
+                finish_publishing(publishing, false);
+                const size_t count = publisher.GetPendingUpdateCount();
+                publishing.push_back(publisher.PublishAsync());
+                writer.BeginObject().Key("publishing").Int(static_cast<int64_t>(count)).EndObject();
+            } else {
+                const auto call = timed_parse([&] { return Requests::ParseStatRequest(doc, request); });
+                snapshot = publisher.Acquire();
+                response = snapshot->MakeCall(call);
+            }
+        } catch (const exception &e) {
+            writer.BeginObject().Key("error_message").Text(e.what()).EndObject();
+        }
+        if (response) {
+            const Metrics::Span serialize(Metrics::Phase::Serialize);
+            response->Write(writer);
+        }
+        writer.Flush();
+        output << '\n'
+               << flush;
+    }
+    finish_publishing(publishing, true);
+}
+
+// With ROUTE_MANAGER_STATS set, metrics are collected and written on exit to
+// the file it names, or to stderr for "-".
+class MetricsDump {
+public:
+    explicit MetricsDump(const char *path) : path_(path) {
+        if (path_)
+            Metrics::Enable();
+    }
+    ~MetricsDump() {
+        if (!path_)
+            return;
+        ofstream file;
+        if (string_view(path_) != "-")
+            file.open(path_);
+        ostream &output = file.is_open() ? file : cerr;
+        {
+            Json::Writer writer(output);
+            Metrics::Write(writer);
+        }
+        output << '\n';
+    }
+
+private:
+    const char *path_;
+};
+
+// Usage:
+//   route_manager                               - serve the default tests file
+//   route_manager make_base <snapshot>          - read base requests from stdin
+//   route_manager process_requests <snapshot>   - read stat requests from stdin
+//                                                 (add --compact to print the
+//                                                 responses without whitespace)
+//   route_manager stream <snapshot or base>     - read stat requests and base
+//                                                 updates from stdin, one JSON
+//                                                 object per line
+int main(int argc, char *argv[]) {
+    const MetricsDump metrics_dump(getenv("ROUTE_MANAGER_STATS"));
+    if (argc == 3 || argc == 4) {
+        const string mode = argv[1];
+        auto style = Json::Writer::Style::Pretty;
+        if (argc == 4) {
+            if (string_view(argv[3]) != "--compact") {
+                cerr << "Unknown option " << argv[3] << '\n';
+                return 1;
+            }
+            style = Json::Writer::Style::Compact;
+        }
+        try {
+            if (mode == "make_base") {
+                make_base(cin, argv[2]);
+            } else if (mode == "process_requests") {
+                process_requests(argv[2], style);
+            } else if (mode == "stream") {
+                serve_stream(argv[2]);
+            } else {
+                cerr << "Unknown mode " << mode << '\n';
+                return 1;
+            }
+        } catch (const exception &e) {
+            cerr << "An error occured: " << e.what() << '\n';
+            return 1;
+        }
+        return 0;
     }
 
     try {
-        serve_requests(file);
-    } catch (...) {
-        file.close();
-        cerr << "An error occured!\n";
+        const MappedFile file(R"(C:\Users\mikes\CLionProjects\route_manager\tests.json)");
+        serve_requests(file.GetText());
+    } catch (const exception &e) {
+        cerr << "An error occured: " << e.what() << '\n';
+        return 1;
     }
-    file.close();
 }
\ No newline at end of file
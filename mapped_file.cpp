@@ -0,0 +1,62 @@
+#include "mapped_file.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_HAS_MMAP 1
+#else
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#endif
+
+MappedFile::MappedFile(const std::string &path) {
+#ifdef MAPPED_FILE_HAS_MMAP
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Unable to open " + path);
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Unable to stat " + path);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ != 0) {
+        void *addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Unable to map " + path);
+        }
+        data_ = static_cast<const std::byte *>(addr);
+    }
+    close(fd);
+#else
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        throw std::runtime_error("Unable to open " + path);
+    }
+    std::transform(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>(),
+                   std::back_inserter(buffer_), [](char c) { return static_cast<std::byte>(c); });
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef MAPPED_FILE_HAS_MMAP
+    if (data_) {
+        munmap(const_cast<std::byte *>(data_), size_);
+    }
+#endif
+}
+
+std::span<const std::byte> MappedFile::GetData() const {
+    return {data_, size_};
+}
+
+std::string_view MappedFile::GetText() const {
+    return {reinterpret_cast<const char *>(data_), size_};
+}
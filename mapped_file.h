@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Read-only view of a whole file. Uses a shared mmap where available, so that
+// the page cache is shared between processes reading the same file and nothing
+// is copied into the process up front.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    std::span<const std::byte> GetData() const;
+    std::string_view GetText() const;
+
+private:
+    const std::byte *data_ = nullptr;
+    size_t size_ = 0;
+    std::vector<std::byte> buffer_;// fallback when mmap is unavailable
+};
@@ -0,0 +1,184 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <string_view>
+
+using namespace std;
+
+namespace Metrics {
+
+    namespace Detail {
+        atomic<bool> enabled = false;
+    }
+
+    namespace {
+        const string_view PHASE_NAMES[] = {"parse", "update", "finalize", "routing_update", "graph_build",
+                                           "router_build", "serialize", "snapshot_save", "snapshot_load", "publish"};
+        const string_view REQUEST_NAMES[] = {"Bus", "Stop", "Route", "Matrix"};
+        const string_view GAUGE_NAMES[] = {"stops", "buses", "vertices", "edges", "router_table_bytes"};
+        const string_view MEMORY_NAMES[] = {"json_document", "catalog", "graph", "router"};
+        static_assert(size(PHASE_NAMES) == static_cast<size_t>(Phase::COUNT));
+        static_assert(size(GAUGE_NAMES) == static_cast<size_t>(Gauge::COUNT));
+        static_assert(size(MEMORY_NAMES) == static_cast<size_t>(Memory::COUNT));
+
+        // bucket b > 0 holds latencies in [2^(b-1), 2^b) ns, the last one
+        // everything longer
+        const size_t BUCKET_COUNT = 41;
+
+        struct PhaseCounters {
+            atomic<uint64_t> nanoseconds = 0, count = 0;
+        };
+
+        struct RequestCounters {
+            atomic<uint64_t> nanoseconds = 0, count = 0, max_nanoseconds = 0;
+            atomic<uint64_t> buckets[BUCKET_COUNT] = {};
+        };
+
+        PhaseCounters phases[static_cast<size_t>(Phase::COUNT)];
+        RequestCounters requests[size(REQUEST_NAMES)];
+        atomic<uint64_t> gauges[static_cast<size_t>(Gauge::COUNT)];
+
+        const uint64_t NOT_ESTIMATED = UINT64_MAX;
+        struct MemoryCounters {
+            atomic<uint64_t> estimated = NOT_ESTIMATED, actual = 0;
+        };
+        atomic<uint64_t> memory_budget = 0;
+        MemoryCounters memory[static_cast<size_t>(Memory::COUNT)];
+
+        uint64_t ToNanoseconds(Clock::duration duration) {
+            return static_cast<uint64_t>(max<int64_t>(chrono::duration_cast<chrono::nanoseconds>(duration).count(), 0));
+        }
+
+        double ToMicroseconds(uint64_t nanoseconds) {
+            return static_cast<double>(nanoseconds) / 1000;
+        }
+
+        uint64_t BucketUpperBound(size_t bucket) {
+            return uint64_t{1} << bucket;
+        }
+
+        // Upper bound of the bucket holding the `share` quantile, at most the maximum
+        uint64_t Percentile(const uint64_t (&buckets)[BUCKET_COUNT], uint64_t count, uint64_t max_nanoseconds, double share) {
+            const auto rank = static_cast<uint64_t>(ceil(share * static_cast<double>(count)));
+            uint64_t seen = 0;
+            for (size_t bucket = 0; bucket != BUCKET_COUNT; ++bucket) {
+                seen += buckets[bucket];
+                if (seen >= rank)
+                    return min(BucketUpperBound(bucket), max_nanoseconds);
+            }
+            return max_nanoseconds;
+        }
+
+        void WriteRequests(Json::Writer &writer, const RequestCounters &counters) {
+            // a snapshot of the counters, which other threads may be updating
+            uint64_t buckets[BUCKET_COUNT];
+            for (size_t bucket = 0; bucket != BUCKET_COUNT; ++bucket)
+                buckets[bucket] = counters.buckets[bucket].load(memory_order_relaxed);
+            const uint64_t count = counters.count.load(memory_order_relaxed);
+            const uint64_t nanoseconds = counters.nanoseconds.load(memory_order_relaxed);
+            const uint64_t max_nanoseconds = counters.max_nanoseconds.load(memory_order_relaxed);
+
+            writer.BeginObject();
+            writer.Key("count").Int(static_cast<int64_t>(count));
+            writer.Key("seconds").Double(static_cast<double>(nanoseconds) / 1e9);
+            if (count != 0) {
+                writer.Key("mean_us").Double(ToMicroseconds(nanoseconds) / static_cast<double>(count));
+                writer.Key("p50_us").Double(ToMicroseconds(Percentile(buckets, count, max_nanoseconds, 0.5)));
+                writer.Key("p90_us").Double(ToMicroseconds(Percentile(buckets, count, max_nanoseconds, 0.9)));
+                writer.Key("p99_us").Double(ToMicroseconds(Percentile(buckets, count, max_nanoseconds, 0.99)));
+                writer.Key("max_us").Double(ToMicroseconds(max_nanoseconds));
+            }
+            writer.Key("histogram").BeginArray();
+            for (size_t bucket = 0; bucket != BUCKET_COUNT; ++bucket) {
+                if (buckets[bucket] == 0)
+                    continue;
+                writer.BeginObject();
+                if (bucket + 1 != BUCKET_COUNT)
+                    writer.Key("below_us").Double(ToMicroseconds(BucketUpperBound(bucket)));
+                writer.Key("count").Int(static_cast<int64_t>(buckets[bucket]));
+                writer.EndObject();
+            }
+            writer.EndArray();
+            writer.EndObject();
+        }
+    }// namespace
+
+    void Enable() {
+        Detail::enabled.store(true, memory_order_relaxed);
+    }
+
+    void AddTime(Phase phase, Clock::duration duration) {
+        auto &counters = phases[static_cast<size_t>(phase)];
+        counters.nanoseconds.fetch_add(ToNanoseconds(duration), memory_order_relaxed);
+        counters.count.fetch_add(1, memory_order_relaxed);
+    }
+
+    void RecordRequest(Requests::StatRequest::Type type, Clock::duration latency) {
+        auto &counters = requests[static_cast<size_t>(type)];
+        const uint64_t nanoseconds = ToNanoseconds(latency);
+        counters.nanoseconds.fetch_add(nanoseconds, memory_order_relaxed);
+        counters.count.fetch_add(1, memory_order_relaxed);
+        counters.buckets[min<size_t>(bit_width(nanoseconds), BUCKET_COUNT - 1)].fetch_add(1, memory_order_relaxed);
+        uint64_t max_nanoseconds = counters.max_nanoseconds.load(memory_order_relaxed);
+        while (nanoseconds > max_nanoseconds &&
+               !counters.max_nanoseconds.compare_exchange_weak(max_nanoseconds, nanoseconds, memory_order_relaxed)) {
+        }
+    }
+
+    void SetGauge(Gauge gauge, uint64_t value) {
+        gauges[static_cast<size_t>(gauge)].store(value, memory_order_relaxed);
+    }
+
+    void SetMemoryBudget(uint64_t bytes) {
+        memory_budget.store(bytes, memory_order_relaxed);
+    }
+
+    void SetMemoryEstimate(Memory part, uint64_t bytes) {
+        memory[static_cast<size_t>(part)].estimated.store(bytes, memory_order_relaxed);
+    }
+
+    void SetMemoryUsage(Memory part, uint64_t bytes) {
+        memory[static_cast<size_t>(part)].actual.store(bytes, memory_order_relaxed);
+    }
+
+    void Write(Json::Writer &writer) {
+        writer.BeginObject();
+        writer.Key("enabled").Bool(IsEnabled());
+
+        writer.Key("phases").BeginObject();
+        for (size_t phase = 0; phase != size(PHASE_NAMES); ++phase) {
+            writer.Key(PHASE_NAMES[phase]).BeginObject();
+            writer.Key("seconds").Double(static_cast<double>(phases[phase].nanoseconds.load(memory_order_relaxed)) / 1e9);
+            writer.Key("count").Int(static_cast<int64_t>(phases[phase].count.load(memory_order_relaxed)));
+            writer.EndObject();
+        }
+        writer.EndObject();
+
+        writer.Key("requests").BeginObject();
+        for (size_t type = 0; type != size(REQUEST_NAMES); ++type) {
+            writer.Key(REQUEST_NAMES[type]);
+            WriteRequests(writer, requests[type]);
+        }
+        writer.EndObject();
+
+        writer.Key("gauges").BeginObject();
+        for (size_t gauge = 0; gauge != size(GAUGE_NAMES); ++gauge)
+            writer.Key(GAUGE_NAMES[gauge]).Int(static_cast<int64_t>(gauges[gauge].load(memory_order_relaxed)));
+        writer.EndObject();
+
+        writer.Key("memory").BeginObject();
+        writer.Key("budget_bytes").Int(static_cast<int64_t>(memory_budget.load(memory_order_relaxed)));
+        for (size_t part = 0; part != size(MEMORY_NAMES); ++part) {
+            writer.Key(MEMORY_NAMES[part]).BeginObject();
+            if (const uint64_t estimated = memory[part].estimated.load(memory_order_relaxed); estimated != NOT_ESTIMATED)
+                writer.Key("estimated_bytes").Int(static_cast<int64_t>(estimated));
+            writer.Key("actual_bytes").Int(static_cast<int64_t>(memory[part].actual.load(memory_order_relaxed)));
+            writer.EndObject();
+        }
+        writer.EndObject();
+        writer.EndObject();
+    }
+
+}// namespace Metrics
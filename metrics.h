@@ -0,0 +1,116 @@
+#pragma once
+
+#include "json_writer.h"
+#include "requests.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Opt-in instrumentation: time spent per phase, latency histograms per stat
+// request type and a few sizes, all in process-wide atomic counters. Until
+// Enable is called every hook is a single relaxed load; once enabled a span
+// costs two steady_clock reads and a few relaxed atomic adds, so it may be
+// left in hot paths.
+//
+// Memory is accounted per part of the process: the estimates RouteManager
+// bases its choice of router on, made before allocating, next to the usage
+// measured afterwards.
+namespace Metrics {
+
+    using Clock = std::chrono::steady_clock;
+
+    enum class Phase {
+        Parse,        // reading base and stat requests from JSON
+        Update,       // MakeUpdate
+        Finalize,     // catalog finalization, including RoutingUpdate
+        RoutingUpdate,// updates applied to an initialized graph and router
+        GraphBuild,
+        RouterBuild,  // includes the all-pairs precomputation
+        Serialize,    // writing responses
+        SnapshotSave,
+        SnapshotLoad,
+        Publish,      // building a snapshot for CatalogPublisher, finalization included
+        COUNT
+    };
+
+    enum class Gauge {
+        Stops,
+        Buses,
+        Vertices,
+        Edges,
+        RouterTableBytes,
+        COUNT
+    };
+
+    enum class Memory {
+        JsonDocument,// input text and parsed stat requests
+        Catalog,
+        Graph,       // routing graph and what its edges mean
+        Router,      // route table or cached shortest-path trees
+        COUNT
+    };
+
+    namespace Detail {
+        extern std::atomic<bool> enabled;
+    }
+
+    void Enable();
+    inline bool IsEnabled() {
+        return Detail::enabled.load(std::memory_order_relaxed);
+    }
+
+    void AddTime(Phase phase, Clock::duration duration);
+    void RecordRequest(Requests::StatRequest::Type type, Clock::duration latency);
+    void SetGauge(Gauge gauge, uint64_t value);
+    void SetMemoryBudget(uint64_t bytes);
+    void SetMemoryEstimate(Memory part, uint64_t bytes);
+    void SetMemoryUsage(Memory part, uint64_t bytes);
+
+    // Adds the lifetime of the span to a phase
+    class Span {
+    public:
+        explicit Span(Phase phase) : phase_(phase), active_(IsEnabled()) {
+            if (active_)
+                start_ = Clock::now();
+        }
+        ~Span() {
+            if (active_)
+                AddTime(phase_, Clock::now() - start_);
+        }
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+
+    private:
+        Phase phase_;
+        bool active_;
+        Clock::time_point start_;
+    };
+
+    // Records the lifetime of the timer as the latency of a request
+    class RequestTimer {
+    public:
+        explicit RequestTimer(Requests::StatRequest::Type type) : type_(type), active_(IsEnabled()) {
+            if (active_)
+                start_ = Clock::now();
+        }
+        ~RequestTimer() {
+            if (active_)
+                RecordRequest(type_, Clock::now() - start_);
+        }
+        RequestTimer(const RequestTimer &) = delete;
+        RequestTimer &operator=(const RequestTimer &) = delete;
+
+    private:
+        Requests::StatRequest::Type type_;
+        bool active_;
+        Clock::time_point start_;
+    };
+
+    // The stats document: phases with their total seconds and span counts,
+    // per request type the count, mean and percentiles (upper bounds of
+    // power-of-two histogram buckets) and the non-empty buckets, gauges and
+    // memory.
+    void Write(Json::Writer &writer);
+
+}// namespace Metrics
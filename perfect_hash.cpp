@@ -0,0 +1,109 @@
+#include "perfect_hash.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+    uint64_t Mix(uint64_t x) {
+        // splitmix64 finalizer
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    // a bucket giving up after this many displacements restarts the build with another seed
+    const uint32_t MAX_DISPLACEMENT = 1 << 16;
+    const uint64_t MAX_SEEDS = 64;
+}// namespace
+
+uint64_t PerfectHash::Hash(string_view key, uint64_t seed) {
+    // FNV-1a with a seeded basis
+    uint64_t hash = 0xcbf29ce484222325ULL ^ Mix(seed);
+    for (const char c : key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return Mix(hash);
+}
+
+uint32_t PerfectHash::GetSlot(uint64_t hash, uint32_t displacement) const {
+    return static_cast<uint32_t>((static_cast<uint32_t>(hash) ^ Mix(displacement)) % slots_.size());
+}
+
+PerfectHash::PerfectHash(span<const string> keys) {
+    if (keys.size() >= NOT_FOUND) {
+        throw length_error("Too many keys for a perfect hash");
+    }
+    for (seed_ = 0; seed_ != MAX_SEEDS; ++seed_) {
+        if (TryBuild(keys)) {
+            return;
+        }
+    }
+    throw invalid_argument("Unable to build a perfect hash, are the keys distinct?");
+}
+
+bool PerfectHash::TryBuild(span<const string> keys) {
+    const size_t key_count = keys.size();
+    // about four keys per bucket and a 0.8 load factor
+    displacements_.assign(key_count / 4 + 1, 0);
+    slots_.assign(key_count + key_count / 4 + 1, NOT_FOUND);
+
+    vector<uint64_t> hashes(key_count);
+    vector<vector<uint32_t>> buckets(displacements_.size());
+    for (uint32_t i = 0; i != key_count; ++i) {
+        hashes[i] = Hash(keys[i], seed_);
+        buckets[(hashes[i] >> 32) % buckets.size()].push_back(i);
+    }
+
+    // the largest buckets are placed first, while most slots are still free
+    vector<uint32_t> order(buckets.size());
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(), [&buckets](uint32_t lhs, uint32_t rhs) {
+        return buckets[lhs].size() > buckets[rhs].size();
+    });
+
+    vector<uint32_t> taken;
+    for (const uint32_t bucket : order) {
+        if (buckets[bucket].empty()) {
+            break;
+        }
+        uint32_t displacement = 0;
+        for (;; ++displacement) {
+            if (displacement == MAX_DISPLACEMENT) {
+                return false;
+            }
+            taken.clear();
+            bool fits = true;
+            for (const uint32_t key : buckets[bucket]) {
+                const uint32_t slot = GetSlot(hashes[key], displacement);
+                if (slots_[slot] != NOT_FOUND || find(taken.begin(), taken.end(), slot) != taken.end()) {
+                    fits = false;
+                    break;
+                }
+                taken.push_back(slot);
+            }
+            if (fits) {
+                break;
+            }
+        }
+        displacements_[bucket] = displacement;
+        for (size_t i = 0; i != taken.size(); ++i) {
+            slots_[taken[i]] = buckets[bucket][i];
+        }
+    }
+    return true;
+}
+
+uint32_t PerfectHash::Find(string_view key, span<const string> keys) const {
+    if (slots_.empty()) {
+        return NOT_FOUND;
+    }
+    const uint64_t hash = Hash(key, seed_);
+    const uint32_t index = slots_[GetSlot(hash, displacements_[(hash >> 32) % displacements_.size()])];
+    return index != NOT_FOUND && keys[index] == key ? index : NOT_FOUND;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Perfect hash over a fixed set of distinct strings ("hash and displace"):
+// keys are split into small buckets, and every bucket gets a displacement that
+// sends all of its keys to free slots. A lookup is one string hash, two array
+// reads and a single comparison against the candidate key.
+class PerfectHash {
+public:
+    static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+    PerfectHash() = default;
+    // `keys` must be distinct.
+    explicit PerfectHash(std::span<const std::string> keys);
+
+    // Index of `key` in `keys`, which must be the span the hash was built from.
+    uint32_t Find(std::string_view key, std::span<const std::string> keys) const;
+
+    size_t GetMemoryUsage() const {
+        return (displacements_.capacity() + slots_.capacity()) * sizeof(uint32_t);
+    }
+
+private:
+    uint64_t seed_ = 0;
+    std::vector<uint32_t> displacements_;// per bucket
+    std::vector<uint32_t> slots_;        // key index or NOT_FOUND
+
+    static uint64_t Hash(std::string_view key, uint64_t seed);
+    uint32_t GetSlot(uint64_t hash, uint32_t displacement) const;
+    bool TryBuild(std::span<const std::string> keys);
+};
@@ -0,0 +1,201 @@
+#include "requests.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+namespace Requests {
+
+    namespace {
+        StatRequest::Type ParseStatType(string_view type) {
+            if (type == "Bus") {
+                return StatRequest::Type::Bus;
+            } else if (type == "Stop") {
+                return StatRequest::Type::Stop;
+            } else if (type == "Matrix") {
+                return StatRequest::Type::Matrix;
+            }
+            return StatRequest::Type::Route;
+        }
+
+        // ids of the keys requests are made of in a particular ArenaDocument
+        struct ArenaKeys {
+            Json::KeyId type, id, name, from, to, sources, targets, with_items, latitude, longitude, road_distances, stops,
+                    is_roundtrip;
+
+            explicit ArenaKeys(const Json::ArenaDocument &doc)
+                : type(doc.FindKey("type")), id(doc.FindKey("id")), name(doc.FindKey("name")),
+                  from(doc.FindKey("from")), to(doc.FindKey("to")),
+                  sources(doc.FindKey("sources")), targets(doc.FindKey("targets")), with_items(doc.FindKey("with_items")),
+                  latitude(doc.FindKey("latitude")), longitude(doc.FindKey("longitude")),
+                  road_distances(doc.FindKey("road_distances")), stops(doc.FindKey("stops")),
+                  is_roundtrip(doc.FindKey("is_roundtrip")) {}
+        };
+
+        double AsNumber(const Json::Node &node) {
+            try {
+                return node.AsDouble();
+            } catch (...) {
+                return node.AsInt();
+            }
+        }
+    }// namespace
+
+    Update ReadUpdate(Json::Reader &reader) {
+        string_view type;
+        StopUpdate stop;
+        BusUpdate bus;
+        reader.BeginObject();
+        for (string_view key; reader.NextKey(key);) {
+            if (key == "type") {
+                type = reader.ReadString();
+            } else if (key == "name") {
+                stop.name = bus.name = reader.ReadString();
+            } else if (key == "latitude") {
+                stop.coords.lat_ = reader.ReadDouble();
+            } else if (key == "longitude") {
+                stop.coords.lon_ = reader.ReadDouble();
+            } else if (key == "road_distances") {
+                reader.BeginObject();
+                for (string_view stop_name; reader.NextKey(stop_name);) {
+                    stop.road_distances.emplace_back(stop_name, reader.ReadInt());
+                }
+            } else if (key == "stops") {
+                reader.BeginArray();
+                while (reader.NextElement()) {
+                    bus.stops.push_back(reader.ReadString());
+                }
+            } else if (key == "is_roundtrip") {
+                bus.is_roundtrip = reader.ReadBool();
+            } else {
+                reader.Skip();
+            }
+        }
+        if (type == "Stop") {
+            return stop;
+        }
+        return bus;
+    }
+
+    StatRequest ReadStatRequest(Json::Reader &reader) {
+        StatRequest res;
+        reader.BeginObject();
+        for (string_view key; reader.NextKey(key);) {
+            if (key == "type") {
+                res.type = ParseStatType(reader.ReadString());
+            } else if (key == "id") {
+                res.id = reader.ReadInt();
+            } else if (key == "name") {
+                res.name = reader.ReadString();
+            } else if (key == "from") {
+                res.from = reader.ReadString();
+            } else if (key == "to") {
+                res.to = reader.ReadString();
+            } else if (key == "sources" || key == "targets") {
+                auto &stops = key == "sources" ? res.sources : res.targets;
+                reader.BeginArray();
+                while (reader.NextElement()) {
+                    stops.push_back(reader.ReadString());
+                }
+            } else if (key == "with_items") {
+                res.with_items = reader.ReadBool();
+            } else {
+                reader.Skip();
+            }
+        }
+        return res;
+    }
+
+    Update ParseUpdate(const map<string, Json::Node> &update) {
+        if (update.at("type").AsString() == "Stop") {
+            StopUpdate stop;
+            stop.name = update.at("name").AsString();
+            stop.coords = {AsNumber(update.at("latitude")), AsNumber(update.at("longitude"))};
+            for (const auto &[stop_name, dist] : update.at("road_distances").AsMap()) {
+                stop.road_distances.emplace_back(stop_name, dist.AsInt());
+            }
+            return stop;
+        }
+        BusUpdate bus;
+        bus.name = update.at("name").AsString();
+        for (const auto &stop_name : update.at("stops").AsArray()) {
+            bus.stops.push_back(stop_name.AsString());
+        }
+        bus.is_roundtrip = update.at("is_roundtrip").AsBool();
+        return bus;
+    }
+
+    StatRequest ParseStatRequest(const map<string, Json::Node> &call) {
+        StatRequest res;
+        res.type = ParseStatType(call.at("type").AsString());
+        res.id = call.at("id").AsInt();
+        if (res.type == StatRequest::Type::Route) {
+            res.from = call.at("from").AsString();
+            res.to = call.at("to").AsString();
+        } else if (res.type == StatRequest::Type::Matrix) {
+            for (const auto &stop_name : call.at("sources").AsArray()) {
+                res.sources.push_back(stop_name.AsString());
+            }
+            for (const auto &stop_name : call.at("targets").AsArray()) {
+                res.targets.push_back(stop_name.AsString());
+            }
+            if (const auto with_items = call.find("with_items"); with_items != call.end()) {
+                res.with_items = with_items->second.AsBool();
+            }
+        } else {
+            res.name = call.at("name").AsString();
+        }
+        return res;
+    }
+
+    Update ParseUpdate(const Json::ArenaDocument &doc, const Json::ArenaNode &update) {
+        if (update.GetKind() != Json::ArenaNode::Kind::Object) {
+            throw invalid_argument("A base request must be a JSON object");
+        }
+        const ArenaKeys keys(doc);
+        if (update.At(keys.type).AsString() == "Stop") {
+            StopUpdate stop;
+            stop.name = update.At(keys.name).AsString();
+            stop.coords = {update.At(keys.latitude).AsDouble(), update.At(keys.longitude).AsDouble()};
+            for (const auto &[stop_name, dist] : update.At(keys.road_distances).AsObject()) {
+                stop.road_distances.emplace_back(doc.GetKey(stop_name), dist.AsInt());
+            }
+            return stop;
+        }
+        BusUpdate bus;
+        bus.name = update.At(keys.name).AsString();
+        for (const auto &stop_name : update.At(keys.stops).AsArray()) {
+            bus.stops.push_back(stop_name.AsString());
+        }
+        bus.is_roundtrip = update.At(keys.is_roundtrip).AsBool();
+        return bus;
+    }
+
+    StatRequest ParseStatRequest(const Json::ArenaDocument &doc, const Json::ArenaNode &call) {
+        if (call.GetKind() != Json::ArenaNode::Kind::Object) {
+            throw invalid_argument("A stat request must be a JSON object");
+        }
+        const ArenaKeys keys(doc);
+        StatRequest res;
+        res.type = ParseStatType(call.At(keys.type).AsString());
+        res.id = call.At(keys.id).AsInt();
+        if (res.type == StatRequest::Type::Route) {
+            res.from = call.At(keys.from).AsString();
+            res.to = call.At(keys.to).AsString();
+        } else if (res.type == StatRequest::Type::Matrix) {
+            for (const auto &stop_name : call.At(keys.sources).AsArray()) {
+                res.sources.push_back(stop_name.AsString());
+            }
+            for (const auto &stop_name : call.At(keys.targets).AsArray()) {
+                res.targets.push_back(stop_name.AsString());
+            }
+            if (const auto *with_items = call.Find(keys.with_items)) {
+                res.with_items = with_items->AsBool();
+            }
+        } else {
+            res.name = call.At(keys.name).AsString();
+        }
+        return res;
+    }
+
+}// namespace Requests
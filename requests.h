@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Coordinates.h"
+#include "json.h"
+#include "json_arena.h"
+#include "json_reader.h"
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Parsed base and stat requests. Strings are views into the input they were
+// read from (a Json::Reader buffer or a DOM), which must outlive them.
+namespace Requests {
+
+    struct StopUpdate {
+        std::string_view name;
+        Coordinates coords{};
+        std::vector<std::pair<std::string_view, int>> road_distances;
+    };
+
+    struct BusUpdate {
+        std::string_view name;
+        std::vector<std::string_view> stops;
+        bool is_roundtrip = false;
+    };
+
+    using Update = std::variant<StopUpdate, BusUpdate>;
+
+    struct StatRequest {
+        enum class Type {
+            Bus,
+            Stop,
+            Route,
+            Matrix// total times from every source stop to every target stop
+        };
+        Type type = Type::Bus;
+        int id = 0;
+        std::string_view name;   // Bus, Stop
+        std::string_view from, to;// Route
+        std::vector<std::string_view> sources, targets;// Matrix
+        bool with_items = false;                       // Matrix: the items of every route too
+    };
+
+    // Read one request object from the reader, skipping unknown keys.
+    Update ReadUpdate(Json::Reader &reader);
+    StatRequest ReadStatRequest(Json::Reader &reader);
+
+    Update ParseUpdate(const std::map<std::string, Json::Node> &update);
+    StatRequest ParseStatRequest(const std::map<std::string, Json::Node> &call);
+
+    Update ParseUpdate(const Json::ArenaDocument &doc, const Json::ArenaNode &update);
+    StatRequest ParseStatRequest(const Json::ArenaDocument &doc, const Json::ArenaNode &call);
+
+}// namespace Requests
@@ -2,253 +2,771 @@
 #include "Response.h"
 
 
+#include <algorithm>
 #include <map>
+#include <numeric>
 #include <regex>
+#include <stdexcept>
+#include <string_view>
 #include <tuple>
+#include <type_traits>
 #include <variant>
 using namespace std;
 
+namespace {
+    // float weights and 32-bit edge ids keep the V^2 table at 8 bytes per pair
+    using RouteTable = Graph::Router<double, float, uint32_t>;
+
+}
+
 RouteManager &RouteManager::MakeUpdate(const map<std::string, Json::Node> &update) {
-    if (update.at("type").AsString() == "Stop") {
-        AddStop(update);
+    return MakeUpdate(Requests::ParseUpdate(update));
+}
+std::unique_ptr<Response> RouteManager::MakeCall(const map<std::string, Json::Node> &call) const {
+    return MakeCall(Requests::ParseStatRequest(call));
+}
+
+RouteManager &RouteManager::MakeUpdate(const Requests::Update &update) {
+    const Metrics::Span timing(Metrics::Phase::Update);
+    if (holds_alternative<Requests::StopUpdate>(update)) {
+        AddStop(get<Requests::StopUpdate>(update));
     } else {
-        AddBus(update);
+        AddBus(get<Requests::BusUpdate>(update));
     }
     return *this;
 }
-std::unique_ptr<Response> RouteManager::MakeCall(const map<std::string, Json::Node> &call) const {
-    if (call.at("type").AsString() == "Bus") {
-        return FindBusInfo(call);
-    } else if (call.at("type").AsString() == "Stop") {
-        return FindStopInfo(call);
-    } else {
-        return FindRoute(call);
+std::unique_ptr<Response> RouteManager::MakeCall(const Requests::StatRequest &call) const {
+    const Metrics::RequestTimer timer(call.type);
+    if (!catalog_.IsFinalized())
+        throw std::logic_error("RouteManager::Finalize must be called before stat requests");
+    switch (call.type) {
+        case Requests::StatRequest::Type::Bus:
+            return FindBusInfo(call);
+        case Requests::StatRequest::Type::Stop:
+            return FindStopInfo(call);
+        case Requests::StatRequest::Type::Matrix:
+            return FindTravelTimes(call);
+        case Requests::StatRequest::Type::Route:
+        default:
+            return FindRoute(call);
     }
 }
 
-RouteManager &RouteManager::AddStop(const map<std::string, Json::Node> &update) {
-    auto &new_stop = stops_[update.at("name").AsString()];
-    new_stop.SetName(update.at("name").AsString());
-    auto lat = [&]() -> variant<int, double> {
-        try {
-            return update.at("latitude").AsDouble();
-        } catch (...) {
-            return update.at("latitude").AsInt();
-        }
-    }();
-    auto lon = [&]() -> variant<int, double> {
-        try {
-            return update.at("longitude").AsDouble();
-        } catch (...) {
-            return update.at("longitude").AsInt();
-        }
-    }();
-    new_stop.SetCoordinates(
-            {holds_alternative<int>(lat)
-                     ? get<int>(lat)
-                     : get<double>(lat),
-             holds_alternative<int>(lon)
-                     ? get<int>(lon)
-                     : get<double>(lon)});
+std::vector<std::unique_ptr<Response>> RouteManager::MakeCalls(std::span<const Requests::StatRequest> calls, ThreadPool &pool) const {
+    const bool has_routes = std::any_of(calls.begin(), calls.end(), [](const Requests::StatRequest &call) {
+        return call.type == Requests::StatRequest::Type::Route || call.type == Requests::StatRequest::Type::Matrix;
+    });
+    if (has_routes)
+        InitRouting();
 
+    std::vector<std::unique_ptr<Response>> responses(calls.size());
+    // a few shards per thread even out the uneven cost of the calls
+    const size_t shard_count = std::min(calls.size(), 4 * pool.GetThreadCount());
+    pool.ParallelFor(shard_count, [&](size_t shard) {
+        const size_t begin = calls.size() * shard / shard_count, end = calls.size() * (shard + 1) / shard_count;
+        for (size_t i = begin; i != end; ++i)
+            responses[i] = MakeCall(calls[i]);
+    });
+    // the on-demand router's cache grows with the calls
+    if (Metrics::IsEnabled() && routing_ready_.load(std::memory_order_acquire))
+        Metrics::SetMemoryUsage(Metrics::Memory::Router, router->GetMemoryUsage());
+    return responses;
+}
 
-    for (auto &[stop_name, dist] : update.at("road_distances").AsMap()) {
-        auto stop_ptr = &stops_[stop_name];
-        int new_dist = dist.AsInt();
+RouteManager &RouteManager::Finalize() {
+    const Metrics::Span timing(Metrics::Phase::Finalize);
+    catalog_.Finalize();
+    Metrics::SetGauge(Metrics::Gauge::Stops, catalog_.GetStopCount());
+    Metrics::SetGauge(Metrics::Gauge::Buses, catalog_.GetBusCount());
+    Metrics::SetMemoryUsage(Metrics::Memory::Catalog, catalog_.GetMemoryUsage());
+    if (graph && (!changed_stops_.empty() || !changed_buses_.empty()))
+        UpdateRouting();
+    return *this;
+}
 
-        new_stop.AddNewAdjacentStop(stop_ptr, new_dist);
-        if (!stop_ptr->IsAdjacentTo(&new_stop)) {
-            stop_ptr->AddNewAdjacentStop(&new_stop, new_dist);
-        }
-    }
+RouteManager &RouteManager::SetRoutingSettings(RoutingSettings settings) {
+    routingSettings = settings;
     return *this;
 }
 
-RouteManager &RouteManager::AddBus(const map<std::string, Json::Node> &update) {
-    auto &new_bus = buses_[update.at("name").AsString()];
-    new_bus.SetId(update.at("name").AsString());
+RouteManager &RouteManager::AddStop(const Requests::StopUpdate &update) {
+    const StopId stop = catalog_.AddStop(update.name);
+    catalog_.SetCoordinates(stop, update.coords);
+    for (auto &[stop_name, dist] : update.road_distances)
+        catalog_.SetDistance(stop, catalog_.AddStop(stop_name), dist);
+    if (graph)
+        changed_stops_.push_back(stop);
+    return *this;
+}
 
-    for (auto &stop_name : update.at("stops").AsArray()) {
-        new_bus.AddStop(&stops_[stop_name.AsString()]);
-        stops_[stop_name.AsString()].AddBus(&new_bus);
-    }
-    if (update.at("is_roundtrip").AsBool())
-        new_bus.MakeCircular();
+RouteManager &RouteManager::AddBus(const Requests::BusUpdate &update) {
+    const BusId bus = catalog_.AddBus(update.name);
+    std::vector<StopId> stops;
+    stops.reserve(update.stops.size());
+    for (auto &stop_name : update.stops)
+        stops.push_back(catalog_.AddStop(stop_name));
+    catalog_.SetRoute(bus, std::move(stops), update.is_roundtrip);
+    if (graph)
+        changed_buses_.push_back(bus);
     return *this;
 }
-std::unique_ptr<Response> RouteManager::FindBusInfo(const map<std::string, Json::Node> &call) const {
-    if (buses_.find(call.at("name").AsString()) != buses_.end())
-        return std::make_unique<BusStats>(buses_.at(call.at("name").AsString()), call.at("id").AsInt());
-    return std::make_unique<StatsNotFound>(call.at("id").AsInt());
+std::unique_ptr<Response> RouteManager::FindBusInfo(const Requests::StatRequest &call) const {
+    if (const auto bus = catalog_.FindBus(call.name))
+        return std::make_unique<BusStats>(catalog_.GetBusSummary(*bus), call.id);
+    return std::make_unique<StatsNotFound>(call.id);
 }
 
-std::unique_ptr<Response> RouteManager::FindStopInfo(const map<std::string, Json::Node> &call) const {
-    if (stops_.find(call.at("name").AsString()) != stops_.end())
-        return std::make_unique<StopStats>(stops_.at(call.at("name").AsString()), call.at("id").AsInt());
-    return std::make_unique<StatsNotFound>(call.at("id").AsInt());
+std::unique_ptr<Response> RouteManager::FindStopInfo(const Requests::StatRequest &call) const {
+    if (const auto stop = catalog_.FindStop(call.name))
+        return std::make_unique<StopStats>(catalog_, catalog_.GetStopBuses(*stop), call.id);
+    return std::make_unique<StatsNotFound>(call.id);
 }
-std::unique_ptr<Response> RouteManager::FindRoute(const map<std::string, Json::Node> &call) const {
-    if (stops_enumeration.empty()) {
-        stops_enumeration = EnumerateStops();
-        inv_stops_enumeration = InvertMap(stops_enumeration);
+void RouteManager::InitRouting() const {
+    if (routing_ready_.load(std::memory_order_acquire))
+        return;
+    std::lock_guard lock(routing_mutex_);
+    if (!routing_ready_.load(std::memory_order_relaxed)) {
+        BuildRouting();
+        routing_ready_.store(true, std::memory_order_release);
     }
+}
+void RouteManager::PrepareGraph() const {
+    if (routing_ready_.load(std::memory_order_acquire))
+        return;
+    std::lock_guard lock(routing_mutex_);
+    BuildGraph();
+}
+void RouteManager::PrepareRouting() const {
+    InitRouting();
+}
+size_t RouteManager::GetGraphEdgeCount() const {
+    return graph ? graph->GetEdgeCount() : 0;
+}
+void RouteManager::BuildRouting() const {
+    BuildGraph();
+    if (!router) {
+        const Metrics::Span timing(Metrics::Phase::RouterBuild);
+        router = MakeRouter();
+    }
+    RecordRoutingGauges();
+}
+RouteManager::RoutingEstimate RouteManager::EstimateRouting(const RoutingSettings &settings) const {
+    size_t vertex_count = catalog_.GetStopCount(), edge_count = 0;
+    for (BusId bus = 0; bus != catalog_.GetBusCount(); ++bus) {
+        const size_t stop_count = catalog_.GetBusStops(bus).size();
+        const bool is_roundtrip = catalog_.IsRoundtrip(bus);
+        if (settings.graph_model == GraphModel::Linear) {
+            // a closed chain of n on-board vertices has 3n edges, an open one 3(n - 1)
+            const size_t on_board = GetOnBoardVertexCount(bus, GraphModel::Linear);
+            vertex_count += on_board;
+            if (is_roundtrip)
+                edge_count += on_board > 1 ? 3 * on_board : 0;
+            else
+                edge_count += stop_count > 1 ? 6 * (stop_count - 1) : 0;
+        } else {
+            const size_t pairs = stop_count * (std::max<size_t>(stop_count, 1) - 1) / 2;
+            if (!is_roundtrip)
+                edge_count += 2 * pairs;
+            else
+                edge_count += pairs + (stop_count > 2 ? (stop_count - 2) * (stop_count - 3) / 2 : 0);
+        }
+    }
+
+    // Per edge: the edge, its info and its incidence list entry, then a second
+    // copy of each while Freeze reorders them. Per vertex: an incidence list,
+    // an offset and the stop <-> vertex maps.
+    const size_t edge_bytes = 2 * (sizeof(Graph::Edge<double>) + sizeof(EdgeInfo) + sizeof(Graph::EdgeId));
+    const size_t vertex_bytes = sizeof(std::vector<Graph::EdgeId>) + sizeof(Graph::EdgeId) + sizeof(StopId) + sizeof(Graph::VertexId);
+    RoutingEstimate res{edge_count * edge_bytes + vertex_count * vertex_bytes, 0};
+    switch (settings.router_mode) {
+        case RouterMode::OnDemand:
+            res.router_bytes = Graph::DijkstraRouter<double>::EstimateMemoryUsage(vertex_count, settings.router_cache_size);
+            break;
+        case RouterMode::Contraction:
+            res.router_bytes = Graph::ContractionRouter<double>::EstimateMemoryUsage(vertex_count, edge_count);
+            break;
+        case RouterMode::AStar:
+            res.router_bytes = Graph::AStarRouter<double>::EstimateMemoryUsage(vertex_count, edge_count, settings.a_star)
+                               + vertex_count * sizeof(Geo::UnitVector);
+            break;
+        case RouterMode::AllPairs:
+        default:
+            res.router_bytes = RouteTable::EstimateMemoryUsage(vertex_count);
+    }
+    return res;
+}
+void RouteManager::ApplyMemoryBudget() const {
+    const size_t budget = routingSettings.memory_budget;
+    Metrics::SetMemoryBudget(budget);
+    if (budget == 0)
+        return;
+    const size_t catalog_bytes = catalog_.GetMemoryUsage();
+    const size_t available = budget > catalog_bytes ? budget - catalog_bytes : 0;
 
+    // fastest first: the configured router with the configured model, then
+    // with the other one, then contraction hierarchies and the on-demand
+    // router the same way
+    const GraphModel other_model = routingSettings.graph_model == GraphModel::Linear ? GraphModel::StopPairs : GraphModel::Linear;
+    std::vector<RouterMode> modes{routingSettings.router_mode};
+    for (const RouterMode mode : {RouterMode::Contraction, RouterMode::OnDemand})
+        if (mode != routingSettings.router_mode)
+            modes.push_back(mode);
+    std::vector<RoutingSettings> candidates;
+    for (const RouterMode mode : modes) {
+        for (const GraphModel model : {routingSettings.graph_model, other_model}) {
+            auto settings = routingSettings;
+            settings.graph_model = model;
+            settings.router_mode = mode;
+            candidates.push_back(settings);
+        }
+    }
+    for (auto &settings : candidates) {
+        auto estimate = EstimateRouting(settings);
+        if (settings.router_mode == RouterMode::OnDemand && estimate.graph_bytes + estimate.router_bytes > available) {
+            // as many trees as fit, if any
+            settings.router_cache_size = 1;
+            estimate = EstimateRouting(settings);
+            const size_t tree_bytes = estimate.router_bytes / 2;
+            if (tree_bytes != 0 && estimate.graph_bytes + estimate.router_bytes <= available)
+                settings.router_cache_size = (available - estimate.graph_bytes) / tree_bytes - 1;
+        }
+        if (estimate.graph_bytes + estimate.router_bytes <= available) {
+            routingSettings = settings;
+            return;
+        }
+    }
+    // nothing fits; the smallest candidate is the best try
+    routingSettings = *std::min_element(candidates.begin(), candidates.end(), [this](const auto &lhs, const auto &rhs) {
+        const auto lhs_estimate = EstimateRouting(lhs), rhs_estimate = EstimateRouting(rhs);
+        return lhs_estimate.graph_bytes + lhs_estimate.router_bytes < rhs_estimate.graph_bytes + rhs_estimate.router_bytes;
+    });
+}
+size_t RouteManager::GetGraphMemoryUsage() const {
+    return graph->GetMemoryUsage() + edges_info.capacity() * sizeof(EdgeInfo)
+           + stop_vertices_.capacity() * sizeof(Graph::VertexId) + vertex_stops_.capacity() * sizeof(StopId)
+           + bus_vertices_.capacity() * sizeof(VertexRange) + vertex_points_.capacity() * sizeof(Geo::UnitVector)
+           + std::accumulate(bus_edges_.begin(), bus_edges_.end(), bus_edges_.capacity() * sizeof(bus_edges_[0]),
+                             [](size_t bytes, const auto &edges) { return bytes + edges.capacity() * sizeof(Graph::EdgeId); });
+}
+void RouteManager::RecordRoutingGauges() const {
+    Metrics::SetMemoryUsage(Metrics::Memory::Graph, GetGraphMemoryUsage());
+    Metrics::SetMemoryUsage(Metrics::Memory::Router, router ? router->GetMemoryUsage() : 0);
+    Metrics::SetGauge(Metrics::Gauge::Vertices, graph->GetVertexCount());
+    Metrics::SetGauge(Metrics::Gauge::Edges, graph->GetEdgeCount());
+    const auto *table = dynamic_cast<const RouteTable *>(router.get());
+    Metrics::SetGauge(Metrics::Gauge::RouterTableBytes, table ? table->GetTable().size() : 0);
+}
+void RouteManager::BuildGraph() const {
     if (!graph.has_value()) {
-        graph.emplace(stops_.size());
-        for (const auto &[name, curr_bus] : buses_) {
-            const auto &curr_bus_stops = curr_bus.GetStops();
-            int initial_number_of_edges = graph->GetEdgeCount();
-            for (auto it1 = curr_bus_stops.begin(); it1 != curr_bus_stops.end(); ++it1) {
-                for (auto it2 = it1; it2 != curr_bus_stops.end(); ++it2) {
-                    graph->AddEdge(
-                            {stops_enumeration.at(*it1),
-                             stops_enumeration.at(*it2),
-                             *it1 == *it2
-                                     ? routingSettings.wait_time
-                                     : (graph->GetEdge(graph->GetEdgeCount() - 1).weight +
-                                        (Stop::dist(*prev(it2), *it2) / routingSettings.velocity))});
-                }
+        ApplyMemoryBudget();
+        const auto estimate = EstimateRouting(routingSettings);
+        Metrics::SetMemoryEstimate(Metrics::Memory::Graph, estimate.graph_bytes);
+        Metrics::SetMemoryEstimate(Metrics::Memory::Router, estimate.router_bytes);
+
+        const Metrics::Span timing(Metrics::Phase::GraphBuild);
+        graph.emplace(LayOutVertices());
+        edges_info.clear();
+        for (BusId bus = 0; bus != catalog_.GetBusCount(); ++bus)
+            AddBusEdges(bus);
+        const auto new_ids = graph->Freeze();
+        if (!edges_info.empty()) {
+            std::vector<EdgeInfo> sorted_edges_info(edges_info.size());
+            for (Graph::EdgeId edge_id = 0; edge_id != edges_info.size(); ++edge_id) {
+                sorted_edges_info[new_ids[edge_id]] = edges_info[edge_id];
             }
-            if (!curr_bus.isCircular()) {
-                for (auto it1 = curr_bus_stops.rbegin(); it1 != curr_bus_stops.rend(); ++it1) {
-                    for (auto it2 = it1; it2 != curr_bus_stops.rend(); ++it2) {
-                        graph->AddEdge(
-                                {stops_enumeration.at(*it1),
-                                 stops_enumeration.at(*it2),
-                                 *it1 == *it2
-                                         ? routingSettings.wait_time
-                                         : (graph->GetEdge(graph->GetEdgeCount() - 1).weight +
-                                            (Stop::dist(*prev(it2), *it2) / routingSettings.velocity))});
-                    }
-                }
-            } else {
-                for (auto it1 = curr_bus_stops.end() - 2; it1 > curr_bus_stops.begin(); --it1) {
-                    for (auto it2 = curr_bus_stops.begin() + 1; it2 < it1; ++it2) {
-                        auto edge_to_end = graph->GetEdge(CalculateEdgeId(it1, curr_bus_stops.end() - 1, curr_bus_stops, initial_number_of_edges));
-                        auto edge_from_start = graph->GetEdge(CalculateEdgeId(curr_bus_stops.begin(), it2, curr_bus_stops, initial_number_of_edges));
-                        auto edge_to_add = Graph::Edge<double>{stops_enumeration.at(*it1),
-                                                               stops_enumeration.at(*it2),
-                                                               edge_from_start.weight + edge_to_end.weight - routingSettings.wait_time};
-                        graph->AddEdge(edge_to_add);
-                    }
-                }
+            edges_info = std::move(sorted_edges_info);
+        }
+    }
+}
+void RouteManager::ResetRouting() const {
+    router.reset();
+    graph.reset();
+    edges_info.clear();
+    bus_edges_.clear();
+    removed_edge_count_ = 0;
+    routing_updated_ = false;
+    routing_ready_.store(false, std::memory_order_release);
+}
+size_t RouteManager::LayOutVertices() const {
+    const size_t stop_count = catalog_.GetStopCount();
+    stop_vertices_.resize(stop_count);
+    iota(stop_vertices_.begin(), stop_vertices_.end(), 0);
+    vertex_stops_.assign(stop_vertices_.begin(), stop_vertices_.end());
+    bus_vertices_.clear();
+    for (BusId bus = 0; bus != catalog_.GetBusCount(); ++bus) {
+        bus_vertices_.push_back({vertex_stops_.size(), GetOnBoardVertexCount(bus, routingSettings.graph_model)});
+        vertex_stops_.resize(vertex_stops_.size() + bus_vertices_.back().count, NO_STOP);
+    }
+    return vertex_stops_.size();
+}
+size_t RouteManager::GetOnBoardVertexCount(BusId bus, GraphModel model) const {
+    if (model != GraphModel::Linear)
+        return 0;
+    const size_t stop_count = catalog_.GetBusStops(bus).size();
+    return catalog_.IsRoundtrip(bus) ? std::max<size_t>(stop_count, 1) - 1 : 2 * stop_count;
+}
+void RouteManager::LocateVertices() const {
+    vertex_points_.assign(graph->GetVertexCount(), {});
+    for (Graph::VertexId vertex = 0; vertex != vertex_stops_.size(); ++vertex)
+        if (vertex_stops_[vertex] != NO_STOP)
+            vertex_points_[vertex] = Geo::ToUnitVector(catalog_.GetCoordinates(vertex_stops_[vertex]));
+    for (Graph::EdgeId edge_id = 0; edge_id != edges_info.size(); ++edge_id) {
+        const auto &edge = graph->GetEdge(edge_id);
+        if (Graph::IsRemoved(edge))
+            continue;
+        if (edges_info[edge_id].kind == EdgeInfo::Kind::Board)
+            vertex_points_[edge.to] = vertex_points_[edge.from];
+        else if (edges_info[edge_id].kind == EdgeInfo::Kind::Alight)
+            vertex_points_[edge.from] = vertex_points_[edge.to];
+    }
+}
+void RouteManager::AddBusEdges(BusId bus) const {
+    if (routingSettings.graph_model == GraphModel::Linear) {
+        AddLinearEdges(bus);
+    } else {
+        AddStopPairsEdges(bus);
+    }
+}
+void RouteManager::AddStopPairsEdges(BusId bus) const {
+    const auto stops = catalog_.GetBusStops(bus);
+    auto add_trip = [&](size_t from, size_t to, int span_count) {
+        graph->AddEdge({stop_vertices_[stops[from]], stop_vertices_[stops[to]],
+                        routingSettings.wait_time + catalog_.GetRouteDistance(bus, from, to) / routingSettings.velocity});
+        edges_info.push_back({bus, span_count, EdgeInfo::Kind::Trip});
+    };
+
+    // an edge from every stop to every later stop, and back for a bus
+    // that is not a roundtrip
+    for (size_t i = 0; i < stops.size(); ++i) {
+        for (size_t j = i + 1; j < stops.size(); ++j) {
+            add_trip(i, j, static_cast<int>(j - i));
+        }
+    }
+    if (!catalog_.IsRoundtrip(bus)) {
+        for (size_t i = stops.size(); i-- > 0;) {
+            for (size_t j = i; j-- > 0;) {
+                add_trip(i, j, static_cast<int>(i - j));
+            }
+        }
+    } else if (stops.size() > 2) {
+        // riding through the terminal: from stop i to the end, then on to stop j < i
+        const size_t last = stops.size() - 1;
+        for (size_t i = last - 1; i > 0; --i) {
+            for (size_t j = 1; j < i; ++j) {
+                add_trip(i, j, static_cast<int>(last - i + j));
             }
         }
     }
+}
+void RouteManager::AddLinearEdges(BusId bus) const {
+    auto add_edge = [this](Graph::VertexId from, Graph::VertexId to, double weight, EdgeInfo info) {
+        graph->AddEdge({from, to, weight});
+        edges_info.push_back(info);
+    };
 
-    if (!router.has_value()) {
-        router.emplace(*graph);
+    // a bus that got longer than its vertices moves to new ones at the end
+    if (bus >= bus_vertices_.size())
+        bus_vertices_.resize(bus + 1, {0, 0});
+    auto &vertices = bus_vertices_[bus];
+    if (const size_t vertex_count = GetOnBoardVertexCount(bus, routingSettings.graph_model); vertex_count > vertices.count) {
+        vertices = {graph->GetVertexCount(), vertex_count};
+        for (size_t i = 0; i != vertex_count; ++i) {
+            graph->AddVertex();
+            vertex_stops_.push_back(NO_STOP);
+        }
     }
-    const auto route = router->BuildRoute(
-            stops_enumeration.at(&stops_.at(call.at("from").AsString())),
-            stops_enumeration.at(&stops_.at(call.at("to").AsString())));
-    bool RouteWasFound = (route != std::nullopt);
-    if (!RouteWasFound)
-        return std::make_unique<StatsNotFound>(call.at("request_id").AsInt());
 
+    const auto stops = catalog_.GetBusStops(bus);
+    Graph::VertexId next_vertex = vertices.begin;
+    // One on-board vertex per stop, the i-th one for stop number position(i)
+    // of the route. A closed chain also rides from the last stop back to
+    // the first one.
+    auto add_chain = [&](size_t length, bool closed, auto position) {
+        const Graph::VertexId chain_begin = next_vertex;
+        for (size_t i = 0; i != length; ++i) {
+            const Graph::VertexId on_board = chain_begin + i;
+            const Graph::VertexId stop = stop_vertices_[stops[position(i)]];
+            const bool has_next = length > 1 && (closed || i + 1 != length);
+            const bool has_prev = length > 1 && (closed || i != 0);
+            if (has_next) {
+                const size_t next = (i + 1) % length;
+                add_edge(stop, on_board, routingSettings.wait_time, {bus, 0, EdgeInfo::Kind::Board});
+                add_edge(on_board, chain_begin + next,
+                         catalog_.GetRouteDistance(bus, position(i), position(next)) / routingSettings.velocity,
+                         {bus, 1, EdgeInfo::Kind::Ride});
+            }
+            if (has_prev) {
+                add_edge(on_board, stop, 0, {bus, 0, EdgeInfo::Kind::Alight});
+            }
+        }
+        next_vertex += length;
+    };
+
+    const size_t stop_count = stops.size();
+    auto forward = [](size_t i) { return i; };
+    if (catalog_.IsRoundtrip(bus)) {
+        if (stop_count != 0)
+            add_chain(stop_count - 1, true, forward);
+    } else {
+        add_chain(stop_count, false, forward);
+        add_chain(stop_count, false, [stop_count](size_t i) { return stop_count - 1 - i; });
+    }
+}
+void RouteManager::UpdateRouting() {
+    const Metrics::Span timing(Metrics::Phase::RoutingUpdate);
+    for (StopId stop = static_cast<StopId>(stop_vertices_.size()); stop != catalog_.GetStopCount(); ++stop) {
+        stop_vertices_.push_back(graph->AddVertex());
+        vertex_stops_.push_back(stop);
+    }
+
+    // A changed stop may have moved or got new distances, which changes the
+    // buses through it. Their edges are all replaced: the old ones are removed
+    // and new ones appended.
+    std::vector<bool> changed(catalog_.GetBusCount());
+    for (const BusId bus : changed_buses_)
+        changed[bus] = true;
+    for (const StopId stop : changed_stops_)
+        for (const BusId bus : catalog_.GetStopBuses(stop))
+            changed[bus] = true;
+    changed_stops_.clear();
+    changed_buses_.clear();
+
+    if (bus_edges_.empty())
+        IndexBusEdges();
+    bus_edges_.resize(catalog_.GetBusCount());
+    std::vector<Graph::EdgeId> removed, added;
+    for (BusId bus = 0; bus != changed.size(); ++bus) {
+        if (!changed[bus])
+            continue;
+        for (const Graph::EdgeId edge_id : bus_edges_[bus])
+            graph->RemoveEdge(edge_id);
+        removed.insert(removed.end(), bus_edges_[bus].begin(), bus_edges_[bus].end());
+        const Graph::EdgeId first_added = graph->GetEdgeCount();
+        AddBusEdges(bus);
+        bus_edges_[bus].resize(graph->GetEdgeCount() - first_added);
+        iota(bus_edges_[bus].begin(), bus_edges_[bus].end(), first_added);
+        added.insert(added.end(), bus_edges_[bus].begin(), bus_edges_[bus].end());
+    }
+    removed_edge_count_ += removed.size();
+    if (2 * removed_edge_count_ > graph->GetEdgeCount()) {
+        ResetRouting();
+        InitRouting();
+        return;
+    }
+
+    if (router) {
+        if (routingSettings.router_mode == RouterMode::AStar)
+            LocateVertices();
+        router->Update(added, removed);
+    }
+    routing_updated_ = true;
+    RecordRoutingGauges();
+}
+void RouteManager::IndexBusEdges() const {
+    bus_edges_.assign(catalog_.GetBusCount(), {});
+    for (Graph::EdgeId edge_id = 0; edge_id != edges_info.size(); ++edge_id)
+        if (!Graph::IsRemoved(graph->GetEdge(edge_id)))
+            bus_edges_[edges_info[edge_id].bus].push_back(edge_id);
+}
+std::unique_ptr<Response> RouteManager::FindRoute(const Requests::StatRequest &call) const {
+    InitRouting();
+    const auto from = catalog_.FindStop(call.from), to = catalog_.FindStop(call.to);
+    if (!from || !to)
+        return std::make_unique<StatsNotFound>(call.id);
+    // a buffer per thread, so that finding the route does not allocate
+    static thread_local std::vector<Graph::EdgeId> route_edges;
+    if (!router->FindRoute(stop_vertices_[*from], stop_vertices_[*to], route_edges))
+        return std::make_unique<StatsNotFound>(call.id);
+    return std::make_unique<Route>(MakeRouteItems(route_edges), call.id);
+}
+
+std::unique_ptr<Response> RouteManager::FindTravelTimes(const Requests::StatRequest &call) const {
+    InitRouting();
+    const auto find_vertices = [this](const std::vector<std::string_view> &names, std::vector<Graph::VertexId> &vertices) {
+        vertices.reserve(names.size());
+        for (const auto name : names) {
+            const auto stop = catalog_.FindStop(name);
+            if (!stop)
+                return false;
+            vertices.push_back(stop_vertices_[*stop]);
+        }
+        return true;
+    };
+    std::vector<Graph::VertexId> sources, targets;
+    if (!find_vertices(call.sources, sources) || !find_vertices(call.targets, targets))
+        return std::make_unique<StatsNotFound>(call.id);
+    std::vector<std::optional<double>> total_times(sources.size() * targets.size());
+    router->FindWeightMatrix(sources, targets, total_times);
+
+    // the items need the routes themselves, found one by one
+    std::vector<std::vector<std::shared_ptr<RouteItem::Item>>> items;
+    if (call.with_items) {
+        items.resize(total_times.size());
+        static thread_local std::vector<Graph::EdgeId> route_edges;
+        for (size_t i = 0; i != total_times.size(); ++i)
+            if (total_times[i] && router->FindRoute(sources[i / targets.size()], targets[i % targets.size()], route_edges))
+                items[i] = MakeRouteItems(route_edges);
+    }
+    return std::make_unique<TravelTimes>(sources.size(), targets.size(), std::move(total_times), call.with_items,
+                                         std::move(items), call.id);
+}
+
+std::vector<std::shared_ptr<RouteItem::Item>> RouteManager::MakeRouteItems(std::span<const Graph::EdgeId> route_edges) const {
     std::vector<std::shared_ptr<RouteItem::Item>> route_items;
-    for (int i = 0; i != route->edge_count; ++i) {
-        int edgeId = router->GetRouteEdge(route->id, i);
-        auto *stop_from = inv_stops_enumeration.at(graph->GetEdge(edgeId).from);
-        auto *stop_to = inv_stops_enumeration.at(graph->GetEdge(edgeId).to);
-        auto weight = graph->GetEdge(edgeId).weight;
-
-        const Bus *curr_bus = FindTheBus(stop_from, stop_to, weight);
-
-        const auto &stops = curr_bus->GetStops();
-        int span_cnt = abs(std::find(curr_bus->GetStops().begin(),
-                                     curr_bus->GetStops().end(),
-                                     stop_to) -
-                           std::find(curr_bus->GetStops().begin(),
-                                     curr_bus->GetStops().end(),
-                                     stop_from));
-        if (span_cnt) {
-            route_items.push_back(
-                    std::make_shared<RouteItem::Wait>(stop_from->GetName(),
-                                                      routingSettings.wait_time));
-            route_items.push_back(
-                    std::make_shared<RouteItem::Bus>(curr_bus->GetId(),
-                                                     span_cnt,
-                                                     weight - routingSettings.wait_time));
-        }
-    }
-    router->ReleaseRoute(route->id);
-    return std::make_unique<Route>(route_items, call.at("id").AsInt());
-}
-unordered_map<const Stop *, Graph::VertexId> RouteManager::EnumerateStops() const {
-    int cnt = 0;
-    std::unordered_map<const Stop *, VertexId> res;
-    for (auto &[name, stop] : stops_) {
-        res[&stop] = cnt++;
+    route_items.reserve(route_edges.size() * 2);
+    std::shared_ptr<RouteItem::Bus> ride;
+    for (const Graph::EdgeId edge_id : route_edges) {
+        const auto &edge = graph->GetEdge(edge_id);
+        const auto &info = edges_info[edge_id];
+        switch (info.kind) {
+            case EdgeInfo::Kind::Trip:
+                route_items.push_back(
+                        std::make_shared<RouteItem::Wait>(catalog_.GetStopName(vertex_stops_[edge.from]),
+                                                          routingSettings.wait_time));
+                route_items.push_back(
+                        std::make_shared<RouteItem::Bus>(catalog_.GetBusName(info.bus),
+                                                         info.span_count,
+                                                         edge.weight - routingSettings.wait_time));
+                break;
+            case EdgeInfo::Kind::Board:
+                route_items.push_back(
+                        std::make_shared<RouteItem::Wait>(catalog_.GetStopName(vertex_stops_[edge.from]),
+                                                          edge.weight));
+                ride = std::make_shared<RouteItem::Bus>(catalog_.GetBusName(info.bus), 0, 0);
+                route_items.push_back(ride);
+                break;
+            case EdgeInfo::Kind::Ride:
+                ride->span_cnt += info.span_count;
+                ride->time += edge.weight;
+                break;
+            case EdgeInfo::Kind::Alight:
+                break;
+        }
     }
-    return res;
+    return route_items;
 }
-unordered_map<Graph::VertexId, const Stop *> RouteManager::InvertMap(const unordered_map<const Stop *, VertexId> &stops_enumeration) {
-    std::unordered_map<VertexId, const Stop *> res;
-    for (auto &[stop, id] : stops_enumeration)
-        res[id] = stop;
-    return res;
+std::unique_ptr<Graph::RoutingEngine<double>> RouteManager::MakeRouter() const {
+    switch (routingSettings.router_mode) {
+        case RouterMode::OnDemand:
+            return std::make_unique<Graph::DijkstraRouter<double>>(*graph, routingSettings.router_cache_size);
+        case RouterMode::Contraction:
+            return std::make_unique<Graph::ContractionRouter<double>>(*graph);
+        case RouterMode::AStar:
+            LocateVertices();
+            return std::make_unique<Graph::AStarRouter<double>>(
+                    *graph, routingSettings.a_star, [this](Graph::VertexId from, Graph::VertexId to) {
+                        return Geo::Distance(vertex_points_[from], vertex_points_[to]);
+                    });
+        case RouterMode::AllPairs:
+        default:
+            return std::make_unique<RouteTable>(*graph, routingSettings.all_pairs);
+    }
 }
-template<typename It>
-Graph::EdgeId RouteManager::CalculateEdgeId(It it1, It it2, const vector<Stop *> &stops, int initial_number_of_edges) const {
-    size_t i = it1 - stops.begin() + 1;
-    size_t j = it2 - stops.begin() + 1;
-    return (i - 1) * stops.size() - std::max({0, static_cast<int>((i - 1) * (i - 2) / 2)}) + (j - i + 1) + initial_number_of_edges;
-}
-const Bus *RouteManager::FindTheBus(const Stop *from, const Stop *to, double weight) const {
-    for (const auto &curr_bus : from->GetBuses()) {
-        double curr_bus_time = 0;
-        bool HasRoute = std::find(curr_bus->GetStops().begin(),
-                                  curr_bus->GetStops().end(),
-                                  to) != curr_bus->GetStops().end();
-        if (!HasRoute) continue;
-        if (!curr_bus->isCircular()) {
-            auto it1 = std::min(std::find(curr_bus->GetStops().begin(),
-                                          curr_bus->GetStops().end(),
-                                          from),
-                                std::find(curr_bus->GetStops().begin(),
-                                          curr_bus->GetStops().end(),
-                                          to));
-            auto it2 = std::max(std::find(curr_bus->GetStops().begin(),
-                                          curr_bus->GetStops().end(),
-                                          from),
-                                std::find(curr_bus->GetStops().begin(),
-                                          curr_bus->GetStops().end(),
-                                          to));
-            if (*it1 == from && *it2 == to)
-                for (auto it = it1; it != it2; ++it) {
-                    curr_bus_time += Stop::dist(*it, *next(it));
-                }
-            else if (*it2 == from && *it1 == to)
-                for (auto it = it2; it != it1; it--) {
-                    curr_bus_time += Stop::dist(*it, *prev(it));
-                }
-        } else {
-            auto it1 = std::find(curr_bus->GetStops().begin(),
-                                 curr_bus->GetStops().end(),
-                                 from);
-            auto it2 = std::find(curr_bus->GetStops().begin(),
-                                 curr_bus->GetStops().end(),
-                                 to);
-            if (it1 < it2) {
-                for (auto it = it1; it != it2; ++it) {
-                    curr_bus_time += Stop::dist(*it, *next(it));
-                }
-            } else {
-                for (auto it = it1; it != std::prev(curr_bus->GetStops().end()); ++it) {
-                    curr_bus_time += Stop::dist(*it, *std::next(it));
-                }
-                for (auto it = curr_bus->GetStops().begin(); it != it2; ++it) {
-                    curr_bus_time += Stop::dist(*it, *std::next(it));
-                }
+namespace {
+    struct StopRecord {
+        Coordinates coords;
+        uint64_t distances_begin, distances_end;
+    };
+    struct DistanceRecord {
+        uint64_t stop;
+        int64_t dist;
+    };
+    // Padding is spelled out and zeroed, so that snapshots of the same base
+    // are identical byte for byte
+    struct BusRecord {
+        uint64_t stops_begin, stops_end;
+        uint8_t is_circular;
+        uint8_t padding[7] = {};
+    };
+    struct EdgeInfoRecord {
+        uint64_t bus;
+        int32_t span_count;
+        uint8_t kind;
+        uint8_t padding[3] = {};
+    };
+    static_assert(has_unique_object_representations_v<BusRecord>);
+    static_assert(has_unique_object_representations_v<EdgeInfoRecord>);
+}// namespace
+
+void RouteManager::SaveSnapshot(const string &path) const {
+    // LoadSnapshot expects the graph BuildRouting makes
+    if (routing_updated_)
+        ResetRouting();
+    InitRouting();
+    const Metrics::Span timing(Metrics::Phase::SnapshotSave);
+
+    Snapshot::Writer writer(path);
+    Snapshot::WriteHeader(writer);
+    writer.Write(routingSettings.wait_time)
+            .Write(routingSettings.velocity)
+            .Write(static_cast<uint32_t>(routingSettings.router_mode))
+            .Write<uint64_t>(routingSettings.router_cache_size)
+            .Write(static_cast<uint32_t>(routingSettings.graph_model))
+            .Write<uint64_t>(routingSettings.a_star.landmark_count);
+
+    // stops and buses in id order, so that the ids survive the round trip
+    vector<StopRecord> stop_records;
+    vector<DistanceRecord> distances;
+    writer.Write<uint64_t>(catalog_.GetStopCount());
+    for (StopId stop = 0; stop != catalog_.GetStopCount(); ++stop) {
+        writer.WriteString(catalog_.GetStopName(stop));
+        stop_records.push_back({catalog_.GetCoordinates(stop), distances.size(), 0});
+        for (const auto &distance : catalog_.GetRoadDistances(stop)) {
+            distances.push_back({distance.to, distance.meters});
+        }
+        stop_records.back().distances_end = distances.size();
+    }
+    writer.WriteArray<StopRecord>(stop_records);
+    writer.WriteArray<DistanceRecord>(distances);
+
+    vector<BusRecord> bus_records;
+    vector<uint64_t> bus_stops;
+    writer.Write<uint64_t>(catalog_.GetBusCount());
+    for (BusId bus = 0; bus != catalog_.GetBusCount(); ++bus) {
+        writer.WriteString(catalog_.GetBusName(bus));
+        bus_records.push_back({bus_stops.size(), 0, catalog_.IsRoundtrip(bus)});
+        for (const StopId stop : catalog_.GetBusStops(bus)) {
+            bus_stops.push_back(stop);
+        }
+        bus_records.back().stops_end = bus_stops.size();
+    }
+    writer.WriteArray<BusRecord>(bus_records);
+    writer.WriteArray<uint64_t>(bus_stops);
+
+    vector<Graph::Edge<double>> edges;
+    edges.reserve(graph->GetEdgeCount());
+    for (Graph::EdgeId edge_id = 0; edge_id != graph->GetEdgeCount(); ++edge_id) {
+        edges.push_back(graph->GetEdge(edge_id));
+    }
+    writer.Write<uint64_t>(graph->GetVertexCount());
+    writer.WriteArray<Graph::Edge<double>>(edges);
+
+    vector<EdgeInfoRecord> edge_info_records;
+    edge_info_records.reserve(edges_info.size());
+    for (const auto &info : edges_info) {
+        edge_info_records.push_back({info.bus, info.span_count, static_cast<uint8_t>(info.kind)});
+    }
+    writer.WriteArray<EdgeInfoRecord>(edge_info_records);
+
+    // the on-demand router has nothing worth saving
+    if (const auto *table = dynamic_cast<const RouteTable *>(router.get())) {
+        writer.WriteArray(table->GetTable());
+    } else {
+        writer.WriteArray(span<const byte>{});
+    }
+    writer.Close();
+}
+
+std::unique_ptr<RouteManager> RouteManager::LoadSnapshot(const string &path) {
+    const Metrics::Span timing(Metrics::Phase::SnapshotLoad);
+    auto file = make_shared<const MappedFile>(path);
+    Snapshot::Reader reader(file->GetData());
+    Snapshot::ReadHeader(reader);
+
+    RoutingSettings settings{reader.Read<double>(), reader.Read<double>()};
+    const auto router_mode = reader.Read<uint32_t>();
+    settings.router_cache_size = reader.Read<uint64_t>();
+    const auto graph_model = reader.Read<uint32_t>();
+    settings.a_star.landmark_count = reader.Read<uint64_t>();
+    if (router_mode > static_cast<uint32_t>(RouterMode::AStar) || graph_model > static_cast<uint32_t>(GraphModel::Linear)) {
+        throw Snapshot::Error("Corrupted settings section");
+    }
+    settings.router_mode = static_cast<RouterMode>(router_mode);
+    settings.graph_model = static_cast<GraphModel>(graph_model);
+    auto res = std::make_unique<RouteManager>(settings);
+
+    auto &catalog = res->catalog_;
+    const auto stop_count = reader.Read<uint64_t>();
+    for (uint64_t stop = 0; stop != stop_count; ++stop) {
+        if (catalog.AddStop(reader.ReadString()) != stop) {
+            throw Snapshot::Error("Duplicate stop name");
+        }
+    }
+    const auto stop_records = reader.ReadArray<StopRecord>();
+    const auto distances = reader.ReadArray<DistanceRecord>();
+    if (stop_records.size() != stop_count) {
+        throw Snapshot::Error("Corrupted stops section");
+    }
+    for (StopId stop = 0; stop != stop_count; ++stop) {
+        const auto &record = stop_records[stop];
+        if (record.distances_begin > record.distances_end || record.distances_end > distances.size()) {
+            throw Snapshot::Error("Corrupted stops section");
+        }
+        catalog.SetCoordinates(stop, record.coords);
+        for (size_t j = record.distances_begin; j != record.distances_end; ++j) {
+            if (distances[j].stop >= stop_count) {
+                throw Snapshot::Error("Corrupted stops section");
             }
+            catalog.SetDistance(stop, static_cast<StopId>(distances[j].stop), static_cast<int>(distances[j].dist));
         }
-        curr_bus_time /= routingSettings.velocity;
+    }
 
-        if (static_cast<float>(weight) == static_cast<float>(curr_bus_time + routingSettings.wait_time))
-            return curr_bus;
-        else
-            int i = 10;
+    const auto bus_count = reader.Read<uint64_t>();
+    for (uint64_t bus = 0; bus != bus_count; ++bus) {
+        if (catalog.AddBus(reader.ReadString()) != bus) {
+            throw Snapshot::Error("Duplicate bus name");
+        }
+    }
+    const auto bus_records = reader.ReadArray<BusRecord>();
+    const auto bus_stops = reader.ReadArray<uint64_t>();
+    if (bus_records.size() != bus_count) {
+        throw Snapshot::Error("Corrupted buses section");
     }
-    throw std::runtime_error("No buses found!");
+    for (BusId bus = 0; bus != bus_count; ++bus) {
+        const auto &record = bus_records[bus];
+        if (record.stops_begin > record.stops_end || record.stops_end > bus_stops.size()) {
+            throw Snapshot::Error("Corrupted buses section");
+        }
+        vector<StopId> stops;
+        for (size_t j = record.stops_begin; j != record.stops_end; ++j) {
+            if (bus_stops[j] >= stop_count) {
+                throw Snapshot::Error("Corrupted buses section");
+            }
+            stops.push_back(static_cast<StopId>(bus_stops[j]));
+        }
+        catalog.SetRoute(bus, std::move(stops), record.is_circular);
+    }
+
+    const auto vertex_count = reader.Read<uint64_t>();
+    const auto edges = reader.ReadArray<Graph::Edge<double>>();
+    if (vertex_count != res->LayOutVertices()) {
+        throw Snapshot::Error("Corrupted graph section");
+    }
+    res->graph.emplace(vertex_count);
+    for (const auto &edge : edges) {
+        // removed edges weigh infinity, which passes
+        if (edge.from >= vertex_count || edge.to >= vertex_count || !(edge.weight >= 0)) {
+            throw Snapshot::Error("Corrupted graph section");
+        }
+        res->graph->AddEdge(edge);
+    }
+    res->graph->Freeze();
+
+    const auto edge_info_records = reader.ReadArray<EdgeInfoRecord>();
+    if (edge_info_records.size() != edges.size()) {
+        throw Snapshot::Error("Corrupted edges section");
+    }
+    for (const auto &record : edge_info_records) {
+        if (record.bus >= bus_count || record.kind > static_cast<uint8_t>(EdgeInfo::Kind::Trip)) {
+            throw Snapshot::Error("Corrupted edges section");
+        }
+        res->edges_info.push_back({static_cast<BusId>(record.bus),
+                                   record.span_count,
+                                   static_cast<EdgeInfo::Kind>(record.kind)});
+    }
+
+    const auto table = reader.ReadArray<byte>();
+    if (settings.router_mode == RouterMode::AllPairs) {
+        res->router = std::make_unique<RouteTable>(*res->graph, table);
+        res->snapshot_ = std::move(file);
+    }
+    res->RecordRoutingGauges();
+    res->Finalize();
+    return res;
+}
+
+std::unique_ptr<RouteManager> RouteManager::CopyBase() const {
+    auto res = std::make_unique<RouteManager>(routingSettings);
+    res->catalog_ = catalog_;
+    return res;
 }
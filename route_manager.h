@@ -1,56 +1,192 @@
 #pragma once
 
-#include "Bus.h"
 #include "Coordinates.h"
 #include "Response.h"
-#include "Stop.h"
+#include "a_star_router.h"
+#include "contraction_router.h"
+#include "dijkstra_router.h"
+#include "geo.h"
 #include "graph.h"
 #include "json.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "requests.h"
 #include "router.h"
+#include "routing_engine.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+#include "transport_catalog.h"
 
+#include <atomic>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
+#include <vector>
+
+enum class RouterMode {
+    AllPairs,// Floyd-Warshall precomputation on the first route request
+    OnDemand,   // Dijkstra per source with an LRU of shortest-path trees
+    Contraction,// contraction hierarchies, built on the first route request
+    AStar       // A* per route, bounded by stop distances and landmarks
+};
+
+enum class GraphModel {
+    StopPairs,// an edge for every pair of stops of a bus, O(k^2) edges per bus
+    Linear    // a vertex per stop plus on-board vertices per bus, O(k) edges per bus
+};
 
 struct RoutingSettings {
     double wait_time, velocity;
     //wait time in mins
     //velocity in metres per min
+    RoutingSettings(double wait_time, double velocity) : wait_time(wait_time), velocity(velocity) {}
+    RouterMode router_mode = RouterMode::AllPairs;
+    GraphModel graph_model = GraphModel::StopPairs;
+    size_t router_cache_size = Graph::DijkstraRouter<double>::DEFAULT_CACHE_CAPACITY;
+    //number of shortest-path trees kept by the on-demand router
+    Graph::AllPairsSettings all_pairs{Graph::AllPairsSettings{}.block_size, ThreadPool::DefaultThreadCount()};
+    Graph::AStarSettings a_star;
+    size_t memory_budget = 0;
+    //bytes for the catalog, graph and router together, 0 for no limit; when
+    //the configured router and graph model would not fit, routing falls back
+    //to the other model, then to contraction hierarchies, then to the
+    //on-demand router with fewer cached trees
 };
 
-
 class RouteManager {
 private:
-    using VertexId = size_t;
-    std::unordered_map<std::string, Stop> stops_;
-    std::unordered_map<std::string, Bus> buses_;
-    RoutingSettings routingSettings;
+    TransportCatalog catalog_;
+    // the memory budget may change the router mode and graph model when
+    // routing is initialized
+    mutable RoutingSettings routingSettings;
 
-    mutable std::unordered_map<const Stop *, VertexId> stops_enumeration{};
-    mutable std::unordered_map<VertexId, const Stop *> inv_stops_enumeration{};
+    // Stop vertices come first and share their ids with the stops; stops
+    // added once the graph is built get vertices at the end.
     mutable std::optional<Graph::DirectedWeightedGraph<double>> graph;
-    mutable std::optional<Graph::Router<double>> router;
-
-    RouteManager &AddStop(const std::map<std::string, Json::Node> &update);
-    RouteManager &AddBus(const std::map<std::string, Json::Node> &update);
+    static constexpr StopId NO_STOP = UINT32_MAX;
+    mutable std::vector<Graph::VertexId> stop_vertices_;
+    mutable std::vector<StopId> vertex_stops_;// NO_STOP for on-board vertices
+    // On-board vertices of every bus (linear model), reused when the bus changes
+    struct VertexRange {
+        Graph::VertexId begin;
+        size_t count;
+    };
+    mutable std::vector<VertexRange> bus_vertices_;
+    // Where every vertex is, for the distance bound of the A* router
+    mutable std::vector<Geo::UnitVector> vertex_points_;
 
-    std::unique_ptr<Response> FindBusInfo(const std::map<std::string, Json::Node> &call) const;
-    std::unique_ptr<Response> FindStopInfo(const std::map<std::string, Json::Node> &call) const;
-    std::unique_ptr<Response> FindRoute(const std::map<std::string, Json::Node> &call) const;
+    // What a graph edge means for the passenger, used to turn routes into items
+    struct EdgeInfo {
+        enum class Kind : uint8_t {
+            Board, // stop -> on-board vertex, waiting for the bus (linear model)
+            Ride,  // on-board vertex -> next on-board vertex of the same bus (linear model)
+            Alight,// on-board vertex -> stop (linear model)
+            Trip   // stop -> stop, waiting and then riding span_count stops (pair model)
+        };
+        BusId bus;
+        int span_count;
+        Kind kind;
+    };
+    mutable std::vector<EdgeInfo> edges_info;// indexed by EdgeId
+    // The edges every bus has in the graph, made by the first update
+    mutable std::vector<std::vector<Graph::EdgeId>> bus_edges_;
+    mutable size_t removed_edge_count_ = 0;
+    mutable std::unique_ptr<Graph::RoutingEngine<double>> router;
+    // Guard the lazy routing initialization, so that calls may run concurrently
+    mutable std::mutex routing_mutex_;
+    mutable std::atomic<bool> routing_ready_ = false;
+    std::shared_ptr<const MappedFile> snapshot_;// backs the router table after LoadSnapshot
+    // Changes since the graph was built, applied to it by Finalize
+    std::vector<StopId> changed_stops_;
+    std::vector<BusId> changed_buses_;
+    mutable bool routing_updated_ = false;// the graph has removed edges, or edges out of CSR order
 
-    std::unordered_map<const Stop *, VertexId> EnumerateStops() const;
-    static std::unordered_map<VertexId, const Stop *> InvertMap(const std::unordered_map<const Stop *, VertexId> &stops_enumeration);
+    RouteManager &AddStop(const Requests::StopUpdate &update);
+    RouteManager &AddBus(const Requests::BusUpdate &update);
 
-    template<typename It>
-    Graph::EdgeId CalculateEdgeId(It it1, It it2, const std::vector<Stop *> &stops, int initial_number_of_edges) const;
+    std::unique_ptr<Response> FindBusInfo(const Requests::StatRequest &call) const;
+    std::unique_ptr<Response> FindStopInfo(const Requests::StatRequest &call) const;
+    std::unique_ptr<Response> FindRoute(const Requests::StatRequest &call) const;
+    std::unique_ptr<Response> FindTravelTimes(const Requests::StatRequest &call) const;
+    std::vector<std::shared_ptr<RouteItem::Item>> MakeRouteItems(std::span<const Graph::EdgeId> route_edges) const;
 
-    const Bus *FindTheBus(const Stop *from, const Stop *to, double weight) const;
+    std::unique_ptr<Graph::RoutingEngine<double>> MakeRouter() const;
+    void InitRouting() const;
+    void BuildRouting() const;
+    void BuildGraph() const;
+    void ResetRouting() const;
+    void RecordRoutingGauges() const;
+    // Lays out the vertices of a new graph and returns their count
+    size_t LayOutVertices() const;
+    size_t GetOnBoardVertexCount(BusId bus, GraphModel model) const;
+    // Fills vertex_points_: a stop vertex is at its stop, an on-board one
+    // where it is boarded or left
+    void LocateVertices() const;
+    // Peak bytes while building the graph, and the router's bytes
+    struct RoutingEstimate {
+        size_t graph_bytes, router_bytes;
+    };
+    RoutingEstimate EstimateRouting(const RoutingSettings &settings) const;
+    void ApplyMemoryBudget() const;
+    size_t GetGraphMemoryUsage() const;
+    void AddBusEdges(BusId bus) const;
+    void AddStopPairsEdges(BusId bus) const;
+    void AddLinearEdges(BusId bus) const;
+    // Rebuilds the edges of the changed buses and lets the router catch up.
+    // Removed edges stay in the graph, so once they outnumber the others the
+    // graph and the router are built anew instead.
+    void UpdateRouting();
+    void IndexBusEdges() const;
 
 public:
-    RouteManager(double wait_time, double velocity) : routingSettings({wait_time, velocity * 16.66}) {}
+    RouteManager() : RouteManager(RoutingSettings{0, 0}) {}
+    explicit RouteManager(RoutingSettings settings) : routingSettings(settings) {}
+    RouteManager(double wait_time, double velocity) : RouteManager(RoutingSettings{wait_time, velocity * 16.66}) {}
+    // Settings may arrive after the base requests; they are only used once
+    // routing is initialized by the first route request.
+    RouteManager &SetRoutingSettings(RoutingSettings settings);
+    // The settings in effect, once routing is initialized with the choices
+    // made for the memory budget
+    const RoutingSettings &GetRoutingSettings() const { return routingSettings; }
+
     RouteManager &MakeUpdate(const std::map<std::string, Json::Node> &update);
     std::unique_ptr<Response> MakeCall(const std::map<std::string, Json::Node> &call) const;
+    RouteManager &MakeUpdate(const Requests::Update &update);
+    std::unique_ptr<Response> MakeCall(const Requests::StatRequest &call) const;
+    // Precomputes the answers to Bus and Stop requests. Must be called after
+    // the base requests and before any stat request; updates undo it.
+    // Once routing is initialized, updates are applied to the graph and the
+    // router here, instead of rebuilding them.
+    RouteManager &Finalize();
+
+    // Answers `calls` on the pool; responses are in the order of the calls.
+    // MakeCall is thread-safe, this only shards the work and initializes
+    // routing up front instead of in whichever worker asks first.
+    std::vector<std::unique_ptr<Response>> MakeCalls(std::span<const Requests::StatRequest> calls, ThreadPool &pool) const;
+
+    // Routing is set up by the first route request; these do it up front,
+    // the graph alone or the graph and the router. Both are thread-safe.
+    void PrepareGraph() const;
+    void PrepareRouting() const;
+
+    // Edges of the routing graph, removed ones included; 0 before it is built
+    size_t GetGraphEdgeCount() const;
+
+    // Builds the routing graph and router if needed and writes them to `path`
+    // together with the stops, buses and settings.
+    void SaveSnapshot(const std::string &path) const;
+    // Restores a manager from SaveSnapshot output without recomputing routes:
+    // the all-pairs table is used directly from the mapped file. Sections that
+    // do not fit together throw Snapshot::Error; the table's cells are trusted,
+    // since checking them would read the whole table up front.
+    static std::unique_ptr<RouteManager> LoadSnapshot(const std::string &path);
+    // A manager with the same stops, buses and settings and no routing, to
+    // be updated and finalized on its own
+    std::unique_ptr<RouteManager> CopyBase() const;
 };
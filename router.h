@@ -1,138 +1,419 @@
 #pragma once
 
 #include "graph.h"
+#include "routing_engine.h"
+#include "thread_pool.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <iterator>
+#include <limits>
+#include <functional>
+#include <memory>
 #include <optional>
-#include <unordered_map>
+#include <queue>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 namespace Graph {
 
-    template <typename Weight>
-    class Router {
+    struct AllPairsSettings {
+        size_t block_size = 64;  // side of the square tiles of the blocked Floyd-Warshall
+        size_t thread_count = 1; // 1 runs the precomputation on the calling thread
+    };
+
+    // All-pairs router: precomputes every route with Floyd-Warshall in the
+    // constructor, so that FindRoute is a plain table walk.
+    //
+    // The table is a single row-major V x V buffer of compact cells. TableWeight
+    // and Index control the cell size: Router<double, float, uint32_t> needs
+    // 8 bytes per pair. Unreachable pairs hold an infinite weight, and
+    // NO_EDGE stands for "no previous edge" (the route's first vertex).
+    //
+    // Floyd-Warshall runs tile by tile: for every diagonal tile K the tile
+    // itself is relaxed first, then the tiles sharing its rows and columns,
+    // then all the others. Tiles of the last two phases are independent and are
+    // spread over a thread pool. With a block size of at least V this is the
+    // plain k-i-j loop.
+    //
+    // A router can also be created over a table computed earlier (e.g. mapped
+    // from a snapshot file); it then only keeps a view of that memory.
+    //
+    // Update repairs the table instead of recomputing it: every added edge
+    // (u, v) relaxes the rows it shortens the route to v in, through row v, and
+    // the rows whose routes went through a removed edge are recomputed with a
+    // single-source Dijkstra. Added edges come first, so that the pruning can
+    // rely on an exact table. A table that is only a view is copied first.
+    template <typename Weight, typename TableWeight = Weight, typename Index = uint32_t>
+    class Router : public RoutingEngine<Weight> {
     private:
         using Graph = DirectedWeightedGraph<Weight>;
+        using Base = RoutingEngine<Weight>;
+
+        static_assert(std::is_unsigned_v<Index>);
 
     public:
-        Router(const Graph& graph);
+        explicit Router(const Graph& graph, AllPairsSettings settings = {});
+        // `table` must outlive the router and come from GetTable() of a router
+        // of the same type built over the same graph.
+        Router(const Graph& graph, std::span<const std::byte> table);
 
-        using RouteId = uint64_t;
+        using typename Base::RouteId;
+        using typename Base::RouteInfo;
 
-        struct RouteInfo {
-            RouteId id;
-            Weight weight;
-            size_t edge_count;
-        };
+        std::optional<Weight> FindRoute(VertexId from, VertexId to, std::vector<EdgeId>& edges) const override;
+        // Walks the routes without storing them
+        void FindWeightMatrix(std::span<const VertexId> sources, std::span<const VertexId> targets,
+                              std::span<std::optional<Weight>> weights) const override;
+        void Update(std::span<const EdgeId> added, std::span<const EdgeId> removed) override;
+        // A mapped table counts too
+        size_t GetMemoryUsage() const override { return GetTable().size(); }
 
-        std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
-        EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
-        void ReleaseRoute(RouteId route_id);
+        std::span<const std::byte> GetTable() const;
+        static size_t EstimateMemoryUsage(size_t vertex_count) {
+            return vertex_count * vertex_count * sizeof(RouteInternalData);
+        }
 
     private:
-        const Graph& graph_;
-
         struct RouteInternalData {
-            Weight weight;
-            std::optional<EdgeId> prev_edge;
+            TableWeight weight;
+            Index prev_edge;
         };
-        using RoutesInternalData = std::vector<std::vector<std::optional<RouteInternalData>>>;
 
-        using ExpandedRoute = std::vector<EdgeId>;
-        mutable RouteId next_route_id_ = 0;
-        mutable std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache_;
+        static constexpr Index NO_EDGE = std::numeric_limits<Index>::max();
+        static constexpr TableWeight UNREACHABLE = std::numeric_limits<TableWeight>::has_infinity
+                                                   ? std::numeric_limits<TableWeight>::infinity()
+                                                   : std::numeric_limits<TableWeight>::max();
+
+        const Graph& graph_;
+        size_t vertex_count_;
+
+        using RoutesInternalData = std::vector<RouteInternalData>;
+
+        static bool IsReachable(const RouteInternalData& route) {
+            return route.weight != UNREACHABLE;
+        }
+
+        RouteInternalData* Row(VertexId vertex_from) {
+            return routes_internal_data_.data() + vertex_from * vertex_count_;
+        }
+        const RouteInternalData* Row(VertexId vertex_from) const {
+            return table_ + vertex_from * vertex_count_;
+        }
 
         void InitializeRoutesInternalData(const Graph& graph) {
-            const size_t vertex_count = graph.GetVertexCount();
-            for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-                routes_internal_data_[vertex][vertex] = RouteInternalData{0, std::nullopt};
+            if (graph.GetEdgeCount() >= NO_EDGE) {
+                throw std::length_error("Too many edges for the route table index type");
+            }
+            for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+                RouteInternalData* row = Row(vertex);
+                row[vertex] = RouteInternalData{0, NO_EDGE};
                 for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
                     const auto& edge = graph.GetEdge(edge_id);
                     assert(edge.weight >= 0);
-                    auto& route_internal_data = routes_internal_data_[vertex][edge.to];
-                    if (!route_internal_data || route_internal_data->weight > edge.weight) {
-                        route_internal_data = RouteInternalData{edge.weight, edge_id};
+                    if (IsRemoved(edge)) {
+                        continue;
+                    }
+                    auto& route_internal_data = row[edge.to];
+                    const auto edge_weight = static_cast<TableWeight>(edge.weight);
+                    if (route_internal_data.weight > edge_weight) {
+                        route_internal_data = RouteInternalData{edge_weight, static_cast<Index>(edge_id)};
                     }
                 }
             }
         }
 
-        void RelaxRoute(VertexId vertex_from, VertexId vertex_to,
-                        const RouteInternalData& route_from, const RouteInternalData& route_to) {
-            auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
-            const Weight candidate_weight = route_from.weight + route_to.weight;
-            if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-                route_relaxing = {
-                        candidate_weight,
-                        route_to.prev_edge
-                        ? route_to.prev_edge
-                        : route_from.prev_edge
-                };
+        struct Block {
+            VertexId begin, end;
+        };
+
+        Block GetBlock(size_t block_idx, size_t block_size) const {
+            return {block_idx * block_size, std::min(vertex_count_, (block_idx + 1) * block_size)};
+        }
+
+        // Relaxes routes from the `from` block to the `to` block through every
+        // vertex of the `through` block.
+        void RelaxBlock(Block from, Block to, Block through) {
+            for (VertexId vertex_through = through.begin; vertex_through < through.end; ++vertex_through) {
+                RelaxRoutesInternalDataThroughVertex(vertex_through, from, to);
             }
         }
 
-        void RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through) {
-            for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
-                if (const auto& route_from = routes_internal_data_[vertex_from][vertex_through]) {
-                    for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
-                        if (const auto& route_to = routes_internal_data_[vertex_through][vertex_to]) {
-                            RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
+        void ComputeRoutesInternalData(AllPairsSettings settings);
+
+        void RelaxRoutesInternalDataThroughVertex(VertexId vertex_through, Block from, Block to) {
+            const RouteInternalData* row_through = Row(vertex_through);
+            for (VertexId vertex_from = from.begin; vertex_from < from.end; ++vertex_from) {
+                RouteInternalData* row_from = Row(vertex_from);
+                const RouteInternalData route_from = row_from[vertex_through];
+                if (!IsReachable(route_from)) {
+                    continue;
+                }
+                for (VertexId vertex_to = to.begin; vertex_to < to.end; ++vertex_to) {
+                    const RouteInternalData& route_to = row_through[vertex_to];
+                    // an infinite weight can never win the comparison below
+                    if constexpr (!std::numeric_limits<TableWeight>::has_infinity) {
+                        if (!IsReachable(route_to)) {
+                            continue;
                         }
                     }
+                    const TableWeight candidate_weight = route_from.weight + route_to.weight;
+                    if (candidate_weight < row_from[vertex_to].weight) {
+                        row_from[vertex_to] = {
+                                candidate_weight,
+                                route_to.prev_edge != NO_EDGE
+                                ? route_to.prev_edge
+                                : route_from.prev_edge
+                        };
+                    }
                 }
             }
         }
 
+        // Takes ownership of the table and grows it to `vertex_count`; new
+        // vertices reach nothing but themselves.
+        void ResizeTable(size_t vertex_count);
+        void InsertEdge(EdgeId edge_id);
+        void RecomputeRow(VertexId vertex_from);
+
         RoutesInternalData routes_internal_data_;
+        const RouteInternalData* table_;
     };
 
 
-    template <typename Weight>
-    Router<Weight>::Router(const Graph& graph)
+    template <typename Weight, typename TableWeight, typename Index>
+    Router<Weight, TableWeight, Index>::Router(const Graph& graph, AllPairsSettings settings)
             : graph_(graph),
-              routes_internal_data_(graph.GetVertexCount(), std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()))
+              vertex_count_(graph.GetVertexCount()),
+              routes_internal_data_(vertex_count_ * vertex_count_, RouteInternalData{UNREACHABLE, NO_EDGE})
     {
+        table_ = routes_internal_data_.data();
         InitializeRoutesInternalData(graph);
+        ComputeRoutesInternalData(settings);
+    }
 
-        const size_t vertex_count = graph.GetVertexCount();
-        for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
-            RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+    template <typename Weight, typename TableWeight, typename Index>
+    Router<Weight, TableWeight, Index>::Router(const Graph& graph, std::span<const std::byte> table)
+            : graph_(graph),
+              vertex_count_(graph.GetVertexCount()),
+              table_(reinterpret_cast<const RouteInternalData*>(table.data()))
+    {
+        if (table.size() != vertex_count_ * vertex_count_ * sizeof(RouteInternalData)
+            || reinterpret_cast<uintptr_t>(table.data()) % alignof(RouteInternalData) != 0) {
+            throw std::invalid_argument("Route table does not match the graph");
         }
     }
 
-    template <typename Weight>
-    std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from, VertexId to) const {
-        const auto& route_internal_data = routes_internal_data_[from][to];
-        if (!route_internal_data) {
-            return std::nullopt;
+    template <typename Weight, typename TableWeight, typename Index>
+    std::span<const std::byte> Router<Weight, TableWeight, Index>::GetTable() const {
+        return std::as_bytes(std::span(table_, vertex_count_ * vertex_count_));
+    }
+
+    template <typename Weight, typename TableWeight, typename Index>
+    void Router<Weight, TableWeight, Index>::ComputeRoutesInternalData(AllPairsSettings settings) {
+        const size_t block_size = std::max<size_t>(settings.block_size, 1);
+        const size_t block_count = (vertex_count_ + block_size - 1) / block_size;
+
+        std::unique_ptr<ThreadPool> pool;
+        if (settings.thread_count > 1 && block_count > 1) {
+            pool = std::make_unique<ThreadPool>(std::min(settings.thread_count, (block_count - 1) * (block_count - 1)));
         }
-        const Weight weight = route_internal_data->weight;
-        std::vector<EdgeId> edges;
-        for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
-             edge_id;
-             edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]->prev_edge) {
-            edges.push_back(*edge_id);
+        auto run_phase = [&pool](size_t task_count, auto task) {
+            if (pool) {
+                pool->ParallelFor(task_count, task);
+            } else {
+                for (size_t i = 0; i != task_count; ++i) {
+                    task(i);
+                }
+            }
+        };
+
+        for (size_t k = 0; k != block_count; ++k) {
+            const Block through = GetBlock(k, block_size);
+            RelaxBlock(through, through, through);
+
+            // tiles in block row k and block column k, skipping the diagonal one
+            run_phase(2 * (block_count - 1), [&](size_t task_idx) {
+                size_t other = task_idx / 2;
+                other += other >= k;
+                const Block block = GetBlock(other, block_size);
+                if (task_idx % 2 == 0) {
+                    RelaxBlock(through, block, through);
+                } else {
+                    RelaxBlock(block, through, through);
+                }
+            });
+
+            run_phase((block_count - 1) * (block_count - 1), [&](size_t task_idx) {
+                size_t i = task_idx / (block_count - 1), j = task_idx % (block_count - 1);
+                i += i >= k;
+                j += j >= k;
+                RelaxBlock(GetBlock(i, block_size), GetBlock(j, block_size), through);
+            });
         }
-        std::reverse(std::begin(edges), std::end(edges));
+    }
 
-        const RouteId route_id = next_route_id_++;
-        const size_t route_edge_count = edges.size();
-        expanded_routes_cache_[route_id] = std::move(edges);
-        return RouteInfo{route_id, weight, route_edge_count};
+    template <typename Weight, typename TableWeight, typename Index>
+    void Router<Weight, TableWeight, Index>::Update(std::span<const EdgeId> added, std::span<const EdgeId> removed) {
+        if (graph_.GetEdgeCount() >= NO_EDGE) {
+            throw std::length_error("Too many edges for the route table index type");
+        }
+        ResizeTable(graph_.GetVertexCount());
+        for (const EdgeId edge_id : added) {
+            InsertEdge(edge_id);
+        }
+
+        // a route uses an edge iff the edge is the last one on the route to its target
+        std::vector<bool> stale_rows(vertex_count_);
+        for (const EdgeId edge_id : removed) {
+            const VertexId to = graph_.GetEdge(edge_id).to;
+            for (VertexId vertex_from = 0; vertex_from < vertex_count_; ++vertex_from) {
+                if (Row(vertex_from)[to].prev_edge == edge_id) {
+                    stale_rows[vertex_from] = true;
+                }
+            }
+        }
+        for (VertexId vertex_from = 0; vertex_from < vertex_count_; ++vertex_from) {
+            if (stale_rows[vertex_from]) {
+                RecomputeRow(vertex_from);
+            }
+        }
     }
 
-    template <typename Weight>
-    EdgeId Router<Weight>::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
-        return expanded_routes_cache_.at(route_id)[edge_idx];
+    template <typename Weight, typename TableWeight, typename Index>
+    void Router<Weight, TableWeight, Index>::ResizeTable(size_t vertex_count) {
+        if (vertex_count == vertex_count_ && table_ == routes_internal_data_.data()) {
+            return;
+        }
+        RoutesInternalData resized(vertex_count * vertex_count, RouteInternalData{UNREACHABLE, NO_EDGE});
+        for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+            std::copy_n(table_ + vertex * vertex_count_, vertex_count_, resized.data() + vertex * vertex_count);
+        }
+        for (VertexId vertex = vertex_count_; vertex < vertex_count; ++vertex) {
+            resized[vertex * vertex_count + vertex] = RouteInternalData{0, NO_EDGE};
+        }
+        routes_internal_data_ = std::move(resized);
+        table_ = routes_internal_data_.data();
+        vertex_count_ = vertex_count;
     }
 
-    template <typename Weight>
-    void Router<Weight>::ReleaseRoute(RouteId route_id) {
-        expanded_routes_cache_.erase(route_id);
+    template <typename Weight, typename TableWeight, typename Index>
+    void Router<Weight, TableWeight, Index>::InsertEdge(EdgeId edge_id) {
+        const auto& edge = graph_.GetEdge(edge_id);
+        if (IsRemoved(edge)) {
+            return;
+        }
+        const auto edge_weight = static_cast<TableWeight>(edge.weight);
+        const RouteInternalData* row_through = Row(edge.to);
+        for (VertexId vertex_from = 0; vertex_from < vertex_count_; ++vertex_from) {
+            RouteInternalData* row_from = Row(vertex_from);
+            if (!IsReachable(row_from[edge.from])) {
+                continue;
+            }
+            // in an exact table a route the edge does not shorten to edge.to
+            // is not shortened anywhere beyond it
+            const TableWeight weight_through = row_from[edge.from].weight + edge_weight;
+            if (!(weight_through < row_from[edge.to].weight)) {
+                continue;
+            }
+            for (VertexId vertex_to = 0; vertex_to < vertex_count_; ++vertex_to) {
+                const RouteInternalData& route_to = row_through[vertex_to];
+                if (!IsReachable(route_to)) {
+                    continue;
+                }
+                const TableWeight candidate_weight = weight_through + route_to.weight;
+                if (candidate_weight < row_from[vertex_to].weight) {
+                    row_from[vertex_to] = {
+                            candidate_weight,
+                            route_to.prev_edge != NO_EDGE
+                            ? route_to.prev_edge
+                            : static_cast<Index>(edge_id)
+                    };
+                }
+            }
+        }
+    }
+
+    template <typename Weight, typename TableWeight, typename Index>
+    void Router<Weight, TableWeight, Index>::RecomputeRow(VertexId vertex_from) {
+        std::vector<std::optional<Weight>> weights(vertex_count_);
+        RouteInternalData* row = Row(vertex_from);
+        std::fill_n(row, vertex_count_, RouteInternalData{UNREACHABLE, NO_EDGE});
+
+        using QueueItem = std::pair<Weight, VertexId>;
+        std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<>> queue;
+        weights[vertex_from] = Weight{0};
+        queue.emplace(Weight{0}, vertex_from);
+        while (!queue.empty()) {
+            const auto [weight, vertex] = queue.top();
+            queue.pop();
+            if (weight > *weights[vertex]) {
+                continue;
+            }
+            row[vertex].weight = static_cast<TableWeight>(weight);
+            for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+                const auto& edge = graph_.GetEdge(edge_id);
+                if (IsRemoved(edge)) {
+                    continue;
+                }
+                const Weight candidate_weight = weight + edge.weight;
+                auto& target_weight = weights[edge.to];
+                if (!target_weight || candidate_weight < *target_weight) {
+                    target_weight = candidate_weight;
+                    row[edge.to].prev_edge = static_cast<Index>(edge_id);
+                    queue.emplace(candidate_weight, edge.to);
+                }
+            }
+        }
+    }
+
+    template <typename Weight, typename TableWeight, typename Index>
+    std::optional<Weight>
+    Router<Weight, TableWeight, Index>::FindRoute(VertexId from, VertexId to, std::vector<EdgeId>& edges) const {
+        edges.clear();
+        const RouteInternalData* row = Row(from);
+        if (!IsReachable(row[to])) {
+            return std::nullopt;
+        }
+        // The table may hold a narrower type than Weight, so the exact weight
+        // is accumulated from the graph while walking the route back.
+        Weight weight = 0;
+        for (Index edge_id = row[to].prev_edge;
+             edge_id != NO_EDGE;
+             edge_id = row[graph_.GetEdge(edge_id).from].prev_edge) {
+            edges.push_back(edge_id);
+            weight += graph_.GetEdge(edge_id).weight;
+        }
+        std::reverse(std::begin(edges), std::end(edges));
+        return weight;
+    }
+
+    template <typename Weight, typename TableWeight, typename Index>
+    void Router<Weight, TableWeight, Index>::FindWeightMatrix(std::span<const VertexId> sources,
+                                                              std::span<const VertexId> targets,
+                                                              std::span<std::optional<Weight>> weights) const {
+        for (size_t i = 0; i != sources.size(); ++i) {
+            const RouteInternalData* row = Row(sources[i]);
+            for (size_t j = 0; j != targets.size(); ++j) {
+                auto& res = weights[i * targets.size() + j];
+                res.reset();
+                if (!IsReachable(row[targets[j]])) {
+                    continue;
+                }
+                // summed from the graph, as FindRoute does
+                Weight weight = 0;
+                for (Index edge_id = row[targets[j]].prev_edge;
+                     edge_id != NO_EDGE;
+                     edge_id = row[graph_.GetEdge(edge_id).from].prev_edge) {
+                    weight += graph_.GetEdge(edge_id).weight;
+                }
+                res = weight;
+            }
+        }
     }
 
 }
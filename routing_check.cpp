@@ -0,0 +1,363 @@
+#include "checker.h"
+#include "city_generator.h"
+#include "json_arena.h"
+#include "json_writer.h"
+#include "requests.h"
+#include "route_manager.h"
+
+#include <cmath>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <memory>
+#include <random>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    const string_view ROUTER_NAMES[] = {"all_pairs", "on_demand", "contraction", "a_star"};
+    const string_view GRAPH_MODEL_NAMES[] = {"stop_pairs", "linear"};
+    const RouterMode ROUTER_MODES[] = {RouterMode::AllPairs, RouterMode::OnDemand, RouterMode::Contraction, RouterMode::AStar};
+    const GraphModel GRAPH_MODELS[] = {GraphModel::StopPairs, GraphModel::Linear};
+    const size_t UPDATE_ROUNDS = 3;
+    const size_t PAIRS_PER_ROUND = 400;
+    const size_t REPEATED_UPDATES = 40;
+    // The all-pairs table keeps float weights, so it may pick a route that is
+    // heavier by a float rounding
+    const double RELATIVE_TOLERANCE = 1e-6;
+
+    bool SameTotal(optional<double> lhs, optional<double> rhs) {
+        if (!lhs || !rhs)
+            return !lhs && !rhs;
+        return abs(*lhs - *rhs) <= RELATIVE_TOLERANCE * max(1.0, abs(*rhs));
+    }
+
+    string ToString(optional<double> total) {
+        return total ? to_string(*total) : "none";
+    }
+
+    // Answers through the public interface, so that the whole path down to
+    // the written response is covered
+    class Answers {
+    public:
+        optional<double> GetRouteTotal(const RouteManager &mg, string_view from, string_view to) {
+            Requests::StatRequest call;
+            call.type = Requests::StatRequest::Type::Route;
+            call.from = from;
+            call.to = to;
+            const auto &response = Load(*mg.MakeCall(call));
+            const auto *total = response.Find(doc_.FindKey("total_time"));
+            if (!total)
+                return nullopt;
+            // an infinite total is written as null, and never matches
+            return total->GetKind() == Json::ArenaNode::Kind::Null ? NAN : total->AsDouble();
+        }
+
+        // Row by row, empty if the request failed
+        vector<optional<double>> GetMatrixTotals(const RouteManager &mg, vector<string_view> sources,
+                                                 vector<string_view> targets) {
+            Requests::StatRequest call;
+            call.type = Requests::StatRequest::Type::Matrix;
+            call.sources = std::move(sources);
+            call.targets = std::move(targets);
+            const auto &response = Load(*mg.MakeCall(call));
+            vector<optional<double>> res;
+            const auto *rows = response.Find(doc_.FindKey("total_times"));
+            if (!rows)
+                return res;
+            for (const auto &row : rows->AsArray())
+                for (const auto &total : row.AsArray())
+                    res.push_back(total.GetKind() == Json::ArenaNode::Kind::Null ? nullopt : optional(total.AsDouble()));
+            return res;
+        }
+
+    private:
+        Json::ArenaDocument doc_;
+        string text_;
+
+        const Json::ArenaNode &Load(const Response &response) {
+            ostringstream output;
+            {
+                Json::Writer writer(output, Json::Writer::Style::Compact);
+                response.Write(writer);
+            }
+            text_ = std::move(output).str();
+            return doc_.Load(text_);
+        }
+    };
+
+    // A generated city split into a base and rounds of updates: buses left
+    // out of the base, new stops with buses through them, and base buses cut
+    // short or extended, which removes edges as well as adding them
+    class CityUpdates {
+    public:
+        explicit CityUpdates(const CityConfig &config) {
+            ostringstream city;
+            {
+                Json::Writer writer(city, Json::Writer::Style::Compact);
+                WriteCity(config, writer);
+            }
+            text_ = std::move(city).str();
+            const auto &root = doc_.Load(text_);
+            vector<Requests::BusUpdate> buses;
+            for (const auto &request : root.At(doc_.FindKey("base_requests")).AsArray()) {
+                auto update = Requests::ParseUpdate(doc_, request);
+                if (auto *stop = get_if<Requests::StopUpdate>(&update)) {
+                    stops_.push_back(*stop);
+                    base_.push_back(std::move(update));
+                } else {
+                    buses.push_back(get<Requests::BusUpdate>(update));
+                }
+            }
+            const size_t base_bus_count = buses.size() * 3 / 4;
+            for (size_t bus = 0; bus != base_bus_count; ++bus)
+                base_.push_back(buses[bus]);
+
+            mt19937_64 random(config.seed);
+            rounds_.resize(UPDATE_ROUNDS);
+            for (size_t bus = base_bus_count; bus != buses.size(); ++bus)
+                rounds_[bus % UPDATE_ROUNDS].push_back(buses[bus]);
+            for (size_t round = 0; round != UPDATE_ROUNDS; ++round) {
+                auto &updates = rounds_[round];
+                // a new stop next to an old one, served by a new bus
+                const auto near = stops_[random() % stops_.size()];
+                const auto name = Keep("New stop " + to_string(round));
+                Requests::StopUpdate stop{name, {near.coords.lat_ + 0.001, near.coords.lon_}, {{near.name, 150}}};
+                stops_.push_back(stop);
+                updates.push_back(stop);
+                updates.push_back(Requests::BusUpdate{Keep("New bus " + to_string(round)), {near.name, name, near.name}, false});
+                // base buses changed in place
+                for (size_t i = 0; i != 3 && base_bus_count != 0; ++i) {
+                    auto bus = buses[random() % base_bus_count];
+                    if (i == 0 && bus.stops.size() > 2)
+                        bus.stops.pop_back();
+                    else
+                        bus.stops.push_back(stops_[random() % stops_.size()].name);
+                    bus.is_roundtrip = false;
+                    updates.push_back(bus);
+                }
+            }
+        }
+
+        const vector<Requests::Update> &GetBase() const { return base_; }
+        const vector<Requests::Update> &GetRound(size_t round) const { return rounds_[round]; }
+        // Stops known once `round` is applied, new ones last
+        span<const Requests::StopUpdate> GetStops(size_t round) const {
+            return span(stops_).first(stops_.size() - UPDATE_ROUNDS + round + 1);
+        }
+
+    private:
+        string text_;
+        Json::ArenaDocument doc_;
+        deque<string> names_;
+        vector<Requests::StopUpdate> stops_;
+        vector<Requests::Update> base_;
+        vector<vector<Requests::Update>> rounds_;
+
+        string_view Keep(string name) {
+            return names_.emplace_back(std::move(name));
+        }
+    };
+
+    RouteManager &Apply(RouteManager &mg, const vector<Requests::Update> &updates) {
+        for (const auto &update : updates)
+            mg.MakeUpdate(update);
+        return mg.Finalize();
+    }
+
+    // Routing prepared before the updates and updated by Finalize must find
+    // the routes a Dijkstra over a graph built from scratch finds
+    void CheckUpdates(const CityConfig &config, const CityUpdates &city, Checker &checker) {
+        mt19937_64 random(config.seed);
+        Answers answers;
+        for (const GraphModel model : GRAPH_MODELS) {
+            RoutingSettings settings{static_cast<double>(config.wait_time), config.velocity * 16.66};
+            settings.graph_model = model;
+            vector<unique_ptr<RouteManager>> updated;
+            for (const RouterMode mode : ROUTER_MODES) {
+                settings.router_mode = mode;
+                updated.push_back(make_unique<RouteManager>(settings));
+                Apply(*updated.back(), city.GetBase()).PrepareRouting();
+            }
+            settings.router_mode = RouterMode::OnDemand;
+            vector<Requests::Update> history = city.GetBase();
+            for (size_t round = 0; round != UPDATE_ROUNDS; ++round) {
+                const auto &updates = city.GetRound(round);
+                history.insert(history.end(), updates.begin(), updates.end());
+                RouteManager reference(settings);
+                Apply(reference, history);
+                for (auto &mg : updated)
+                    Apply(*mg, updates);
+
+                const auto stops = city.GetStops(round);
+                for (size_t pair = 0; pair != PAIRS_PER_ROUND; ++pair) {
+                    const auto from = stops[random() % stops.size()].name, to = stops[random() % stops.size()].name;
+                    const auto expected = answers.GetRouteTotal(reference, from, to);
+                    for (size_t mode = 0; mode != updated.size(); ++mode) {
+                        const auto total = answers.GetRouteTotal(*updated[mode], from, to);
+                        checker.Expect(SameTotal(total, expected),
+                                       string(ROUTER_NAMES[mode]) + "/" + string(GRAPH_MODEL_NAMES[static_cast<size_t>(model)])
+                                               + " after update " + to_string(round + 1) + ": " + string(from) + " -> "
+                                               + string(to) + " took " + ToString(total) + ", expected " + ToString(expected));
+                    }
+                }
+            }
+        }
+    }
+
+    // Updating one bus over and over must not grow the graph without bound:
+    // removed edges are dropped by rebuilding it once they outnumber the
+    // others, after which routing must still be right
+    void CheckRepeatedUpdates(const CityConfig &config, const CityUpdates &city, Checker &checker) {
+        mt19937_64 random(config.seed + 3);
+        Answers answers;
+        vector<Requests::Update> history = city.GetBase();
+        for (size_t round = 0; round != UPDATE_ROUNDS; ++round)
+            history.insert(history.end(), city.GetRound(round).begin(), city.GetRound(round).end());
+        const auto stops = city.GetStops(UPDATE_ROUNDS - 1);
+        // the longest bus, which has the most edges to remove
+        Requests::BusUpdate bus;
+        for (const auto &update : history)
+            if (const auto *other = get_if<Requests::BusUpdate>(&update); other && other->stops.size() > bus.stops.size())
+                bus = *other;
+        if (bus.stops.empty())
+            return;
+        vector<Requests::Update> variants[2] = {{bus}, {bus}};
+        get<Requests::BusUpdate>(variants[1][0]).stops.push_back(stops[random() % stops.size()].name);
+
+        for (const GraphModel model : GRAPH_MODELS) {
+            RoutingSettings settings{static_cast<double>(config.wait_time), config.velocity * 16.66};
+            settings.graph_model = model;
+            // edges of a graph built from scratch with either variant
+            size_t live_edge_counts[2];
+            for (size_t variant = 0; variant != 2; ++variant) {
+                RouteManager fresh(settings);
+                Apply(Apply(fresh, history), variants[variant]).PrepareGraph();
+                live_edge_counts[variant] = fresh.GetGraphEdgeCount();
+            }
+            settings.router_mode = RouterMode::OnDemand;
+            RouteManager reference(settings);
+            Apply(Apply(reference, history), variants[REPEATED_UPDATES % 2]);
+            for (size_t mode = 0; mode != size(ROUTER_MODES); ++mode) {
+                // an update of the all-pairs table over the on-board vertices
+                // takes as long as rebuilding it; CheckUpdates covers it
+                if (ROUTER_MODES[mode] == RouterMode::AllPairs && model == GraphModel::Linear)
+                    continue;
+                settings.router_mode = ROUTER_MODES[mode];
+                RouteManager mg(settings);
+                Apply(mg, history).PrepareRouting();
+                const string name = string(ROUTER_NAMES[mode]) + "/" + string(GRAPH_MODEL_NAMES[static_cast<size_t>(model)]);
+                bool rebuilt = false;
+                for (size_t update = 1; update <= REPEATED_UPDATES; ++update) {
+                    const size_t edge_count = mg.GetGraphEdgeCount();
+                    Apply(mg, variants[update % 2]);
+                    rebuilt = rebuilt || mg.GetGraphEdgeCount() < edge_count;
+                    checker.Expect(mg.GetGraphEdgeCount() <= 2 * live_edge_counts[update % 2],
+                                   name + ": " + to_string(mg.GetGraphEdgeCount()) + " edges after update "
+                                           + to_string(update) + " of one bus, "
+                                           + to_string(live_edge_counts[update % 2]) + " in use");
+                }
+                checker.Expect(rebuilt, name + ": the graph was never rebuilt");
+                for (size_t pair = 0; pair != PAIRS_PER_ROUND; ++pair) {
+                    const auto from = stops[random() % stops.size()].name, to = stops[random() % stops.size()].name;
+                    const auto expected = answers.GetRouteTotal(reference, from, to);
+                    const auto total = answers.GetRouteTotal(mg, from, to);
+                    checker.Expect(SameTotal(total, expected),
+                                   name + " after " + to_string(REPEATED_UPDATES) + " updates of one bus: " + string(from)
+                                           + " -> " + string(to) + " took " + ToString(total) + ", expected "
+                                           + ToString(expected));
+                }
+            }
+        }
+    }
+
+    // Every router built over the whole city must find the routes a Dijkstra
+    // finds, one by one and as a matrix
+    void CheckFromScratch(const CityConfig &config, const CityUpdates &city, Checker &checker) {
+        mt19937_64 random(config.seed + 1);
+        Answers answers;
+        vector<Requests::Update> history = city.GetBase();
+        for (size_t round = 0; round != UPDATE_ROUNDS; ++round)
+            history.insert(history.end(), city.GetRound(round).begin(), city.GetRound(round).end());
+        const auto stops = city.GetStops(UPDATE_ROUNDS - 1);
+        const auto pick_stops = [&](size_t count) {
+            vector<string_view> res;
+            for (size_t i = 0; i != count; ++i)
+                res.push_back(stops[random() % stops.size()].name);
+            return res;
+        };
+
+        for (const GraphModel model : GRAPH_MODELS) {
+            RoutingSettings settings{static_cast<double>(config.wait_time), config.velocity * 16.66};
+            settings.graph_model = model;
+            settings.router_mode = RouterMode::OnDemand;
+            RouteManager reference(settings);
+            Apply(reference, history);
+            for (size_t mode = 0; mode != size(ROUTER_MODES); ++mode) {
+                settings.router_mode = ROUTER_MODES[mode];
+                RouteManager mg(settings);
+                Apply(mg, history);
+                const string name = string(ROUTER_NAMES[mode]) + "/" + string(GRAPH_MODEL_NAMES[static_cast<size_t>(model)]);
+                for (size_t pair = 0; pair != PAIRS_PER_ROUND; ++pair) {
+                    const auto from = stops[random() % stops.size()].name, to = stops[random() % stops.size()].name;
+                    const auto expected = answers.GetRouteTotal(reference, from, to);
+                    const auto total = answers.GetRouteTotal(mg, from, to);
+                    checker.Expect(SameTotal(total, expected),
+                                   name + ": " + string(from) + " -> " + string(to) + " took " + ToString(total)
+                                           + ", expected " + ToString(expected));
+                }
+                // sources and targets may repeat
+                const auto sources = pick_stops(12), targets = pick_stops(17);
+                const auto totals = answers.GetMatrixTotals(mg, sources, targets);
+                checker.Expect(totals.size() == sources.size() * targets.size(), name + ": matrix of the wrong size");
+                for (size_t i = 0; i != totals.size(); ++i) {
+                    const auto from = sources[i / targets.size()], to = targets[i % targets.size()];
+                    const auto expected = answers.GetRouteTotal(reference, from, to);
+                    checker.Expect(SameTotal(totals[i], expected),
+                                   name + " matrix: " + string(from) + " -> " + string(to) + " took "
+                                           + ToString(totals[i]) + ", expected " + ToString(expected));
+                }
+            }
+        }
+    }
+}// namespace
+
+// Usage:
+//   routing_check [--<option> <value>]...
+// Generates a city with generate_city's options (a small one by default) and
+// checks routing on it against a plain Dijkstra, for every router and graph
+// model: after updates applied to prepared routing, including many updates of
+// one bus, and built from scratch, route by route and as a matrix. Failed
+// checks are printed on stderr, and make the exit code 1.
+int main(int argc, char *argv[]) {
+    CityConfig config;
+    config.stop_count = 150;
+    config.bus_count = 30;
+    config.max_route_length = 12;
+    try {
+        for (int i = 1; i < argc; i += 2) {
+            const string_view arg = argv[i];
+            if (arg.substr(0, 2) != "--" || i + 1 == argc || !SetCityOption(config, arg.substr(2), argv[i + 1])) {
+                cerr << "Unknown option " << arg << '\n';
+                return 1;
+            }
+        }
+        Checker checker;
+        const CityUpdates city(config);
+        CheckUpdates(config, city, checker);
+        CheckRepeatedUpdates(config, city, checker);
+        CheckFromScratch(config, city, checker);
+        return checker.Report();
+    } catch (const exception &e) {
+        cerr << "An error occured: " << e.what() << '\n';
+        return 1;
+    }
+}
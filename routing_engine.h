@@ -0,0 +1,129 @@
+#pragma once
+
+#include "graph.h"
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+    // Common interface of all routing strategies, so that RouteManager can
+    // switch between them without knowing how routes are actually found.
+    //
+    // FindRoute is the primary API: it is const and re-entrant, and writes the
+    // route into a buffer owned by the caller. With a buffer per thread it
+    // does not allocate once the buffer has grown to the longest route.
+    // BuildRoute keeps the route in the engine instead, to be read edge by
+    // edge and released; it allocates and locks on every call. Routes may be
+    // found, built, read and released from several threads at once.
+    template <typename Weight>
+    class RoutingEngine {
+    public:
+        using RouteId = uint64_t;
+
+        struct RouteInfo {
+            RouteId id;
+            Weight weight;
+            size_t edge_count;
+        };
+
+        virtual ~RoutingEngine() = default;
+
+        // Replaces the contents of `edges` with the route and returns its
+        // weight; nullopt, with `edges` left empty, if there is no route
+        virtual std::optional<Weight> FindRoute(VertexId from, VertexId to, std::vector<EdgeId>& edges) const = 0;
+        // Calls `visit(edge_id)` for every edge of the route in order, through
+        // a buffer per thread
+        template <typename Visitor>
+        std::optional<Weight> VisitRoute(VertexId from, VertexId to, Visitor visit) const;
+
+        // Weights of the routes from every source to every target, row by row:
+        // the route from sources[i] to targets[j] goes to
+        // weights[i * targets.size() + j], nullopt if there is none. This one
+        // finds every route on its own; engines override it with searches
+        // shared between the pairs.
+        virtual void FindWeightMatrix(std::span<const VertexId> sources, std::span<const VertexId> targets,
+                                      std::span<std::optional<Weight>> weights) const;
+
+        std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+        // Catches up with changes made to the graph since the engine was built
+        // or last updated: vertices appended, `added` edges appended and
+        // `removed` edges removed. Must not run concurrently with route queries.
+        virtual void Update(std::span<const EdgeId> added, std::span<const EdgeId> removed) = 0;
+        // Bytes of precomputed or cached routes, not counting the graph
+        virtual size_t GetMemoryUsage() const = 0;
+        EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
+        void ReleaseRoute(RouteId route_id);
+
+    private:
+        using ExpandedRoute = std::vector<EdgeId>;
+
+        RouteInfo StoreRoute(Weight weight, ExpandedRoute edges) const;
+
+        mutable std::mutex routes_mutex_;
+        mutable RouteId next_route_id_ = 0;
+        mutable std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache_;
+    };
+
+
+    template <typename Weight>
+    template <typename Visitor>
+    std::optional<Weight> RoutingEngine<Weight>::VisitRoute(VertexId from, VertexId to, Visitor visit) const {
+        static thread_local std::vector<EdgeId> edges;
+        const auto weight = FindRoute(from, to, edges);
+        for (const EdgeId edge_id : edges) {
+            visit(edge_id);
+        }
+        return weight;
+    }
+
+    template <typename Weight>
+    void RoutingEngine<Weight>::FindWeightMatrix(std::span<const VertexId> sources, std::span<const VertexId> targets,
+                                                 std::span<std::optional<Weight>> weights) const {
+        static thread_local std::vector<EdgeId> edges;
+        for (size_t i = 0; i != sources.size(); ++i) {
+            for (size_t j = 0; j != targets.size(); ++j) {
+                weights[i * targets.size() + j] = FindRoute(sources[i], targets[j], edges);
+            }
+        }
+    }
+
+    template <typename Weight>
+    std::optional<typename RoutingEngine<Weight>::RouteInfo>
+    RoutingEngine<Weight>::BuildRoute(VertexId from, VertexId to) const {
+        ExpandedRoute edges;
+        const auto weight = FindRoute(from, to, edges);
+        if (!weight) {
+            return std::nullopt;
+        }
+        return StoreRoute(*weight, std::move(edges));
+    }
+
+    template <typename Weight>
+    EdgeId RoutingEngine<Weight>::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
+        std::lock_guard lock(routes_mutex_);
+        return expanded_routes_cache_.at(route_id)[edge_idx];
+    }
+
+    template <typename Weight>
+    void RoutingEngine<Weight>::ReleaseRoute(RouteId route_id) {
+        std::lock_guard lock(routes_mutex_);
+        expanded_routes_cache_.erase(route_id);
+    }
+
+    template <typename Weight>
+    typename RoutingEngine<Weight>::RouteInfo
+    RoutingEngine<Weight>::StoreRoute(Weight weight, ExpandedRoute edges) const {
+        std::lock_guard lock(routes_mutex_);
+        const RouteId route_id = next_route_id_++;
+        const size_t route_edge_count = edges.size();
+        expanded_routes_cache_[route_id] = std::move(edges);
+        return RouteInfo{route_id, weight, route_edge_count};
+    }
+
+}
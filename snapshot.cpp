@@ -0,0 +1,76 @@
+#include "snapshot.h"
+
+namespace Snapshot {
+
+    Writer::Writer(const std::string &path) : output_(path, std::ios::binary | std::ios::trunc) {
+        if (!output_) {
+            throw Error("Unable to open " + path + " for writing");
+        }
+    }
+
+    Writer &Writer::WriteBytes(const void *data, size_t size) {
+        output_.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+        offset_ += size;
+        return *this;
+    }
+
+    Writer &Writer::WriteString(std::string_view str) {
+        Write<uint64_t>(str.size());
+        return WriteBytes(str.data(), str.size());
+    }
+
+    Writer &Writer::Align(size_t alignment) {
+        static constexpr char zeroes[alignof(std::max_align_t)] = {};
+        const size_t padding = (alignment - offset_ % alignment) % alignment;
+        return WriteBytes(zeroes, padding);
+    }
+
+    void Writer::Close() {
+        output_.close();
+        if (!output_) {
+            throw Error("Unable to write the snapshot");
+        }
+    }
+
+    std::span<const std::byte> Reader::Take(size_t size) {
+        if (size > data_.size() - offset_) {
+            throw Error("Snapshot is truncated");
+        }
+        const auto res = data_.subspan(offset_, size);
+        offset_ += size;
+        return res;
+    }
+
+    std::string_view Reader::ReadString() {
+        const auto size = Read<uint64_t>();
+        const auto bytes = Take(size);
+        return {reinterpret_cast<const char *>(bytes.data()), bytes.size()};
+    }
+
+    void Reader::Align(size_t alignment) {
+        Take((alignment - offset_ % alignment) % alignment);
+    }
+
+    bool LooksLikeSnapshot(std::span<const std::byte> data) {
+        return data.size() >= MAGIC.size() && std::memcmp(data.data(), MAGIC.data(), MAGIC.size()) == 0;
+    }
+
+    void WriteHeader(Writer &writer) {
+        writer.Write(MAGIC)
+                .Write(VERSION)
+                .Write(BYTE_ORDER_MARK);
+    }
+
+    void ReadHeader(Reader &reader) {
+        if (reader.Read<std::array<char, 8>>() != MAGIC) {
+            throw Error("Not a snapshot file");
+        }
+        if (reader.Read<uint32_t>() != VERSION) {
+            throw Error("Unsupported snapshot version");
+        }
+        if (reader.Read<uint32_t>() != BYTE_ORDER_MARK) {
+            throw Error("Snapshot was written on an incompatible architecture");
+        }
+    }
+
+}// namespace Snapshot
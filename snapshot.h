@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Binary snapshot files: a fixed header followed by sections written in a
+// fixed order. Values are stored in the native byte order and layout, so a
+// snapshot is only readable on the architecture that wrote it; the header
+// carries a byte order mark to reject foreign files.
+namespace Snapshot {
+
+    inline constexpr std::array<char, 8> MAGIC = {'T', 'R', 'D', 'B', 'S', 'N', 'A', 'P'};
+    inline constexpr uint32_t VERSION = 4;
+    inline constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+    struct Error : std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    class Writer {
+    public:
+        explicit Writer(const std::string &path);
+
+        template<typename T>
+        Writer &Write(const T &value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            return WriteBytes(&value, sizeof(T));
+        }
+        Writer &WriteString(std::string_view str);
+        template<typename T>
+        Writer &WriteArray(std::span<const T> values) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            Write<uint64_t>(values.size());
+            Align(alignof(std::max_align_t));
+            return WriteBytes(values.data(), values.size_bytes());
+        }
+
+        // Pads the file with zeroes up to a multiple of `alignment`.
+        Writer &Align(size_t alignment);
+        void Close();
+
+    private:
+        std::ofstream output_;
+        size_t offset_ = 0;
+
+        Writer &WriteBytes(const void *data, size_t size);
+    };
+
+    // Bounds-checked cursor over a mapped snapshot. Arrays and strings are
+    // returned as views into the mapping and are never copied.
+    class Reader {
+    public:
+        explicit Reader(std::span<const std::byte> data) : data_(data) {}
+
+        template<typename T>
+        T Read() {
+            static_assert(std::is_trivially_copyable_v<T>);
+            T value;
+            std::memcpy(&value, Take(sizeof(T)).data(), sizeof(T));
+            return value;
+        }
+        std::string_view ReadString();
+        template<typename T>
+        std::span<const T> ReadArray() {
+            static_assert(std::is_trivially_copyable_v<T>);
+            const auto count = Read<uint64_t>();
+            Align(alignof(std::max_align_t));
+            if (count > (data_.size() - offset_) / sizeof(T)) {
+                throw Error("Snapshot is truncated");
+            }
+            const auto bytes = Take(count * sizeof(T));
+            return {reinterpret_cast<const T *>(bytes.data()), count};
+        }
+
+        void Align(size_t alignment);
+
+    private:
+        std::span<const std::byte> data_;
+        size_t offset_ = 0;
+
+        std::span<const std::byte> Take(size_t size);
+    };
+
+    // Whether `data` starts like a snapshot file (the version is not checked).
+    bool LooksLikeSnapshot(std::span<const std::byte> data);
+
+    void WriteHeader(Writer &writer);
+    // Throws Snapshot::Error if the header does not match this build.
+    void ReadHeader(Reader &reader);
+
+}// namespace Snapshot
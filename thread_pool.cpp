@@ -0,0 +1,46 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    thread_count = std::max<size_t>(thread_count, 1);
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i != thread_count; ++i) {
+        workers_.emplace_back([this] { Work(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    has_tasks_.notify_all();
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetThreadCount() const {
+    return workers_.size();
+}
+
+size_t ThreadPool::DefaultThreadCount() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void ThreadPool::Work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mutex_);
+            has_tasks_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        task();
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Fixed-size pool of worker threads executing submitted tasks in FIFO order.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t GetThreadCount() const;
+
+    template<typename Task>
+    std::future<std::invoke_result_t<Task>> Submit(Task task);
+
+    // Runs task(0), ..., task(count - 1) on the pool and waits for all of them.
+    // Once all of them are done, the first exception thrown by the tasks (in
+    // index order) is rethrown to the caller.
+    template<typename Task>
+    void ParallelFor(size_t count, Task task);
+
+    static size_t DefaultThreadCount();
+
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable has_tasks_;
+    bool stopping_ = false;
+
+    void Work();
+};
+
+
+template<typename Task>
+std::future<std::invoke_result_t<Task>> ThreadPool::Submit(Task task) {
+    using Result = std::invoke_result_t<Task>;
+    auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+    auto result = packaged->get_future();
+    {
+        std::lock_guard lock(mutex_);
+        tasks_.emplace([packaged] { (*packaged)(); });
+    }
+    has_tasks_.notify_one();
+    return result;
+}
+
+template<typename Task>
+void ThreadPool::ParallelFor(size_t count, Task task) {
+    std::vector<std::future<void>> results;
+    results.reserve(count);
+    for (size_t i = 0; i != count; ++i) {
+        results.push_back(Submit([&task, i] { task(i); }));
+    }
+    // every task refers to `task`, so all of them must be done before the
+    // first exception leaves
+    for (auto &result : results) {
+        result.wait();
+    }
+    for (auto &result : results) {
+        result.get();
+    }
+}
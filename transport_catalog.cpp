@@ -0,0 +1,304 @@
+#include "transport_catalog.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
+
+using namespace std;
+
+StopId TransportCatalog::AddStop(string_view name) {
+    Unfinalize();
+    if (auto it = stop_index_.find(name); it != stop_index_.end())
+        return it->second;
+    const auto id = static_cast<StopId>(stop_names_.size());
+    stop_index_.emplace(name, id);
+    stop_names_.emplace_back(name);
+    stop_coords_.push_back({});
+    return id;
+}
+
+BusId TransportCatalog::AddBus(string_view name) {
+    Unfinalize();
+    if (auto it = bus_index_.find(name); it != bus_index_.end())
+        return it->second;
+    const auto id = static_cast<BusId>(bus_names_.size());
+    bus_index_.emplace(name, id);
+    bus_names_.emplace_back(name);
+    bus_stops_.emplace_back();
+    bus_is_roundtrip_.push_back(false);
+    return id;
+}
+
+void TransportCatalog::SetCoordinates(StopId stop, Coordinates coords) {
+    Unfinalize();
+    stop_coords_[stop] = coords;
+}
+
+void TransportCatalog::SetDistance(StopId from, StopId to, int meters) {
+    Unfinalize();
+    distance_entries_.push_back({from, {to, meters}});
+}
+
+void TransportCatalog::SetRoute(BusId bus, vector<StopId> stops, bool is_roundtrip) {
+    Unfinalize();
+    bus_stops_[bus] = std::move(stops);
+    bus_is_roundtrip_[bus] = is_roundtrip;
+}
+
+void TransportCatalog::Finalize() {
+    if (finalized_)
+        return;
+    stop_hash_ = PerfectHash(stop_names_);
+    bus_hash_ = PerfectHash(bus_names_);
+    stop_index_ = {};
+    bus_index_ = {};
+    PackDistances();
+    PackStopBuses();
+    stop_points_.Reserve(stop_coords_.size());
+    for (const auto &coords : stop_coords_)
+        stop_points_.Add(Geo::ToUnitVector(coords));
+    finalized_ = true;
+    ComputeRouteDistances();
+
+    bus_summaries_.resize(bus_names_.size());
+    for (BusId bus = 0; bus != bus_names_.size(); ++bus)
+        bus_summaries_[bus] = ComputeBusSummary(bus);
+}
+
+void TransportCatalog::Unfinalize() {
+    if (!finalized_)
+        return;
+    finalized_ = false;
+    for (StopId stop = 0; stop != stop_names_.size(); ++stop)
+        stop_index_.emplace(stop_names_[stop], stop);
+    for (BusId bus = 0; bus != bus_names_.size(); ++bus)
+        bus_index_.emplace(bus_names_[bus], bus);
+    for (StopId stop = 0; stop != stop_names_.size(); ++stop)
+        for (const auto &distance : GetRoadDistances(stop))
+            distance_entries_.push_back({stop, distance});
+    stop_hash_ = {};
+    bus_hash_ = {};
+    stop_points_ = {};
+    distances_offsets_ = {};
+    distances_ = {};
+    stop_buses_offsets_ = {};
+    stop_buses_ = {};
+    route_offsets_ = {};
+    forward_distances_ = {};
+    backward_distances_ = {};
+    geo_distances_ = {};
+}
+
+void TransportCatalog::PackDistances() {
+    // a stable sort keeps the entries set later after the earlier ones, and
+    // the later ones win
+    stable_sort(distance_entries_.begin(), distance_entries_.end(), [](const auto &lhs, const auto &rhs) {
+        return tie(lhs.from, lhs.distance.to) < tie(rhs.from, rhs.distance.to);
+    });
+    distances_offsets_.assign(stop_names_.size() + 1, 0);
+    distances_.clear();
+    for (size_t i = 0; i != distance_entries_.size(); ++i) {
+        const auto &entry = distance_entries_[i];
+        if (i + 1 != distance_entries_.size() && entry.from == distance_entries_[i + 1].from &&
+            entry.distance.to == distance_entries_[i + 1].distance.to)
+            continue;
+        distances_.push_back(entry.distance);
+        ++distances_offsets_[entry.from + 1];
+    }
+    partial_sum(distances_offsets_.begin(), distances_offsets_.end(), distances_offsets_.begin());
+    distance_entries_ = {};
+}
+
+void TransportCatalog::PackStopBuses() {
+    vector<BusId> buses_by_name(bus_names_.size());
+    iota(buses_by_name.begin(), buses_by_name.end(), 0);
+    sort(buses_by_name.begin(), buses_by_name.end(), [this](BusId lhs, BusId rhs) {
+        return bus_names_[lhs] < bus_names_[rhs];
+    });
+
+    // counting sort by stop; going through the buses by name keeps every
+    // stop's list sorted
+    vector<StopId> last_bus(stop_names_.size(), UINT32_MAX);
+    stop_buses_offsets_.assign(stop_names_.size() + 1, 0);
+    for (const BusId bus : buses_by_name) {
+        for (const StopId stop : bus_stops_[bus]) {
+            if (last_bus[stop] != bus) {
+                last_bus[stop] = bus;
+                ++stop_buses_offsets_[stop + 1];
+            }
+        }
+    }
+    partial_sum(stop_buses_offsets_.begin(), stop_buses_offsets_.end(), stop_buses_offsets_.begin());
+
+    vector<uint32_t> positions(stop_buses_offsets_.begin(), stop_buses_offsets_.end() - 1);
+    stop_buses_.resize(stop_buses_offsets_.back());
+    fill(last_bus.begin(), last_bus.end(), UINT32_MAX);
+    for (const BusId bus : buses_by_name) {
+        for (const StopId stop : bus_stops_[bus]) {
+            if (last_bus[stop] != bus) {
+                last_bus[stop] = bus;
+                stop_buses_[positions[stop]++] = bus;
+            }
+        }
+    }
+}
+
+void TransportCatalog::ComputeRouteDistances() {
+    route_offsets_.assign(bus_names_.size() + 1, 0);
+    for (BusId bus = 0; bus != bus_names_.size(); ++bus)
+        route_offsets_[bus + 1] = route_offsets_[bus] + static_cast<uint32_t>(bus_stops_[bus].size());
+    const size_t point_count = route_offsets_.back();
+    forward_distances_.resize(point_count);
+    backward_distances_.resize(point_count);
+    geo_distances_.resize(point_count);
+
+    // great-circle lengths of all segments at once, in one batch over the
+    // routes laid end to end (the segments joining two routes are not used)
+    Geo::Points route_points;
+    route_points.Reserve(point_count);
+    for (const auto &stops : bus_stops_)
+        for (const StopId stop : stops)
+            route_points.Add(stop_points_[stop]);
+    vector<double> segments(max<size_t>(point_count, 1) - 1);
+    if (!segments.empty())
+        Geo::Distances(route_points.View().Subspan(0, segments.size()), route_points.View().Subspan(1, segments.size()), segments);
+
+    for (BusId bus = 0; bus != bus_names_.size(); ++bus) {
+        const auto &stops = bus_stops_[bus];
+        if (stops.empty())
+            continue;
+        int *forward = &forward_distances_[route_offsets_[bus]];
+        int *backward = &backward_distances_[route_offsets_[bus]];
+        double *geo = &geo_distances_[route_offsets_[bus]];
+        forward[0] = backward[0] = 0;
+        geo[0] = 0;
+        for (size_t i = 1; i != stops.size(); ++i) {
+            forward[i] = forward[i - 1] + GetDistance(stops[i - 1], stops[i]);
+            backward[i] = backward[i - 1] + GetDistance(stops[i], stops[i - 1]);
+            geo[i] = geo[i - 1] + segments[route_offsets_[bus] + i - 1];
+        }
+    }
+}
+
+int TransportCatalog::GetRouteDistance(BusId bus, size_t from, size_t to) const {
+    const int *forward = &forward_distances_[route_offsets_[bus]];
+    if (from <= to)
+        return forward[to] - forward[from];
+    if (bus_is_roundtrip_[bus]) {
+        const size_t last = bus_stops_[bus].size() - 1;
+        return forward[last] - forward[from] + forward[to];
+    }
+    const int *backward = &backward_distances_[route_offsets_[bus]];
+    return backward[from] - backward[to];
+}
+
+double TransportCatalog::GetGeoRouteLength(BusId bus) const {
+    const size_t stop_count = bus_stops_[bus].size();
+    if (stop_count == 0)
+        return 0;
+    const double length = geo_distances_[route_offsets_[bus] + stop_count - 1];
+    return bus_is_roundtrip_[bus] ? length : 2 * length;
+}
+
+BusSummary TransportCatalog::ComputeBusSummary(BusId bus) const {
+    const auto &stops = bus_stops_[bus];
+    const bool is_roundtrip = bus_is_roundtrip_[bus];
+    BusSummary res;
+    if (stops.empty())
+        return res;
+
+    res.stop_count = static_cast<int>(is_roundtrip ? stops.size() : 2 * stops.size() - 1);
+    vector<StopId> unique_stops = stops;
+    sort(unique_stops.begin(), unique_stops.end());
+    res.unique_stop_count = static_cast<int>(unique(unique_stops.begin(), unique_stops.end()) - unique_stops.begin());
+
+    const size_t last = stops.size() - 1;
+    res.route_length = GetRouteDistance(bus, 0, last);
+    if (!is_roundtrip)
+        res.route_length += GetRouteDistance(bus, last, 0);
+    res.curvature = res.route_length / GetGeoRouteLength(bus);
+    return res;
+}
+
+namespace {
+    template<typename T>
+    size_t VectorBytes(const vector<T> &v) {
+        return v.capacity() * sizeof(T);
+    }
+
+    size_t NamesBytes(const vector<string> &names) {
+        size_t res = VectorBytes(names);
+        for (const auto &name : names) {
+            // short names live inside the string object
+            const auto *object = reinterpret_cast<const char *>(&name);
+            if (name.data() < object || name.data() >= object + sizeof(name))
+                res += name.capacity() + 1;
+        }
+        return res;
+    }
+
+    // an estimate: a node per element plus the bucket array
+    template<typename T>
+    size_t MapBytes(const StringMap<T> &map) {
+        return map.size() * (sizeof(typename StringMap<T>::value_type) + 2 * sizeof(void *))
+               + map.bucket_count() * sizeof(void *);
+    }
+}// namespace
+
+size_t TransportCatalog::GetMemoryUsage() const {
+    size_t res = NamesBytes(stop_names_) + VectorBytes(stop_coords_) + NamesBytes(bus_names_)
+                 + VectorBytes(bus_stops_) + bus_is_roundtrip_.capacity() / 8 + VectorBytes(bus_summaries_)
+                 + MapBytes(stop_index_) + MapBytes(bus_index_) + VectorBytes(distance_entries_)
+                 + stop_hash_.GetMemoryUsage() + bus_hash_.GetMemoryUsage() + 3 * sizeof(double) * stop_points_.Size()
+                 + VectorBytes(distances_offsets_) + VectorBytes(distances_) + VectorBytes(stop_buses_offsets_)
+                 + VectorBytes(stop_buses_) + VectorBytes(route_offsets_) + VectorBytes(forward_distances_)
+                 + VectorBytes(backward_distances_) + VectorBytes(geo_distances_);
+    for (const auto &stops : bus_stops_)
+        res += VectorBytes(stops);
+    return res;
+}
+
+optional<StopId> TransportCatalog::FindStop(string_view name) const {
+    if (!finalized_) {
+        auto it = stop_index_.find(name);
+        return it != stop_index_.end() ? optional(it->second) : nullopt;
+    }
+    const auto id = stop_hash_.Find(name, stop_names_);
+    return id != PerfectHash::NOT_FOUND ? optional(id) : nullopt;
+}
+
+optional<BusId> TransportCatalog::FindBus(string_view name) const {
+    if (!finalized_) {
+        auto it = bus_index_.find(name);
+        return it != bus_index_.end() ? optional(it->second) : nullopt;
+    }
+    const auto id = bus_hash_.Find(name, bus_names_);
+    return id != PerfectHash::NOT_FOUND ? optional(id) : nullopt;
+}
+
+span<const BusId> TransportCatalog::GetStopBuses(StopId stop) const {
+    return span(stop_buses_).subspan(stop_buses_offsets_[stop], stop_buses_offsets_[stop + 1] - stop_buses_offsets_[stop]);
+}
+
+span<const RoadDistance> TransportCatalog::GetRoadDistances(StopId stop) const {
+    return span(distances_).subspan(distances_offsets_[stop], distances_offsets_[stop + 1] - distances_offsets_[stop]);
+}
+
+const RoadDistance *TransportCatalog::FindRoadDistance(StopId from, StopId to) const {
+    const auto distances = GetRoadDistances(from);
+    const auto it = lower_bound(distances.begin(), distances.end(), to, [](const RoadDistance &distance, StopId stop) {
+        return distance.to < stop;
+    });
+    return it != distances.end() && it->to == to ? &*it : nullptr;
+}
+
+int TransportCatalog::GetDistance(StopId from, StopId to) const {
+    if (!finalized_)
+        throw logic_error("The catalog must be finalized first");
+    if (const auto *distance = FindRoadDistance(from, to))
+        return distance->meters;
+    if (const auto *distance = FindRoadDistance(to, from))
+        return distance->meters;
+    return static_cast<int>(Geo::Distance(stop_points_[from], stop_points_[to]));
+}
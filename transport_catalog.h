@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Coordinates.h"
+#include "geo.h"
+#include "perfect_hash.h"
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Lets the name-keyed maps be searched by std::string_view without a copy
+struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view str) const {
+        return std::hash<std::string_view>{}(str);
+    }
+};
+template<typename T>
+using StringMap = std::unordered_map<std::string, T, StringHash, std::equal_to<>>;
+
+using StopId = uint32_t;
+using BusId = uint32_t;
+
+// What a Bus request answers with, computed once by TransportCatalog::Finalize
+struct BusSummary {
+    int stop_count = 0, unique_stop_count = 0, route_length = 0;
+    double curvature = 0;
+};
+
+struct RoadDistance {
+    StopId to;
+    int meters;
+};
+
+// Stops and buses interned to dense ids, in the order their names are first
+// mentioned, with every attribute kept in its own id-indexed array.
+//
+// While the base is loaded names are resolved through hash maps. Finalize
+// replaces those with perfect hashes over the name arrays, packs the per-stop
+// lists into offset arrays and computes cumulative distances along every bus
+// route; the catalog can only be queried once it is finalized. Any later
+// change takes it back to the loading state.
+class TransportCatalog {
+public:
+    // Returns the id of the stop, adding a stop without coordinates if needed
+    StopId AddStop(std::string_view name);
+    BusId AddBus(std::string_view name);
+    void SetCoordinates(StopId stop, Coordinates coords);
+    // Road distance from `from` to `to`; unless set explicitly, the way back
+    // is as long.
+    void SetDistance(StopId from, StopId to, int meters);
+    void SetRoute(BusId bus, std::vector<StopId> stops, bool is_roundtrip);
+
+    void Finalize();
+    bool IsFinalized() const { return finalized_; }
+
+    std::optional<StopId> FindStop(std::string_view name) const;
+    std::optional<BusId> FindBus(std::string_view name) const;
+
+    size_t GetStopCount() const { return stop_names_.size(); }
+    std::string_view GetStopName(StopId stop) const { return stop_names_[stop]; }
+    Coordinates GetCoordinates(StopId stop) const { return stop_coords_[stop]; }
+    // Buses stopping at `stop`, sorted by name
+    std::span<const BusId> GetStopBuses(StopId stop) const;
+    // Distances set explicitly from `stop`, sorted by destination
+    std::span<const RoadDistance> GetRoadDistances(StopId stop) const;
+    // Road distance, or the (truncated) great-circle one if no road distance
+    // is known
+    int GetDistance(StopId from, StopId to) const;
+
+    size_t GetBusCount() const { return bus_names_.size(); }
+    std::string_view GetBusName(BusId bus) const { return bus_names_[bus]; }
+    std::span<const StopId> GetBusStops(BusId bus) const { return bus_stops_[bus]; }
+    bool IsRoundtrip(BusId bus) const { return bus_is_roundtrip_[bus]; }
+    const BusSummary &GetBusSummary(BusId bus) const { return bus_summaries_[bus]; }
+    // Road distance covered by `bus` between its stops number `from` and `to`.
+    // For from > to a roundtrip bus goes on through its terminal (the first
+    // and the last stop), any other bus rides back along its stops.
+    int GetRouteDistance(BusId bus, size_t from, size_t to) const;
+    // Great-circle length of the whole route, both ways for a non-roundtrip bus
+    double GetGeoRouteLength(BusId bus) const;
+
+    // Heap bytes held by the catalog
+    size_t GetMemoryUsage() const;
+
+private:
+    bool finalized_ = false;
+
+    std::vector<std::string> stop_names_;
+    std::vector<Coordinates> stop_coords_;
+
+    std::vector<std::string> bus_names_;
+    std::vector<std::vector<StopId>> bus_stops_;
+    std::vector<bool> bus_is_roundtrip_;
+    std::vector<BusSummary> bus_summaries_;
+
+    // loading state: name indexes and distances in the order they were set
+    StringMap<StopId> stop_index_;
+    StringMap<BusId> bus_index_;
+    struct DistanceEntry {
+        StopId from;
+        RoadDistance distance;
+    };
+    std::vector<DistanceEntry> distance_entries_;
+
+    // finalized state
+    PerfectHash stop_hash_, bus_hash_;
+    Geo::Points stop_points_;// unit vectors of stop_coords_
+    std::vector<uint32_t> distances_offsets_;// stop -> range in distances_
+    std::vector<RoadDistance> distances_;
+    std::vector<uint32_t> stop_buses_offsets_;// stop -> range in stop_buses_
+    std::vector<BusId> stop_buses_;
+    // per bus, prefix sums over its stops: route_offsets_[bus] is where they
+    // start, entry i covers stops 0..i
+    std::vector<uint32_t> route_offsets_;
+    std::vector<int> forward_distances_;  // riding along the stops
+    std::vector<int> backward_distances_; // riding back, from stop i to stop 0
+    std::vector<double> geo_distances_;
+
+    void Unfinalize();
+    void PackDistances();
+    void PackStopBuses();
+    void ComputeRouteDistances();
+    BusSummary ComputeBusSummary(BusId bus) const;
+    const RoadDistance *FindRoadDistance(StopId from, StopId to) const;
+};